@@ -0,0 +1,405 @@
+/*
+* This software is provided as is, without any warranty, express or implied.
+* This software is licensed under a Creative Commons (CC BY-NC-SA) license.
+* This software is authored by Catwashere (2025).
+*/
+
+// times the hot paths on synthetic capture buffers, with no capture board and no window, and prints the results as json
+#define XX3DSDL_NO_MAIN
+#define XX3DSDL_NO_DEVICE
+#include "xx3dsdl.cpp"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#define BENCH_RUNS 25
+#define BENCH_TIME 20000000
+
+class Bench {
+public:
+	struct Result {
+		std::string name;
+		uint64_t bytes;
+		uint64_t iterations;
+		double mean;
+		double stddev;
+		double min;
+		bool exact;
+	};
+
+	static inline std::vector<Result> results;
+
+	// the iterations per run are calibrated to take about BENCH_TIME nanoseconds, and the spread between runs is the variance reported
+	template <typename Function>
+	static inline void run(std::string name, uint64_t bytes, bool exact, Function function) {
+		uint64_t iterations = 1;
+
+		while (Bench::time(function, iterations) < BENCH_TIME / 4 && iterations < (1 << 24)) {
+			iterations *= 2;
+		}
+
+		iterations = std::max<uint64_t>(1, iterations * BENCH_TIME / std::max<uint64_t>(1, Bench::time(function, iterations)));
+
+		double runs[BENCH_RUNS];
+		double mean = 0;
+
+		for (int i = 0; i < BENCH_RUNS; ++i) {
+			runs[i] = static_cast<double>(Bench::time(function, iterations)) / iterations;
+			mean += runs[i] / BENCH_RUNS;
+		}
+
+		double variance = 0;
+
+		for (int i = 0; i < BENCH_RUNS; ++i) {
+			variance += (runs[i] - mean) * (runs[i] - mean) / BENCH_RUNS;
+		}
+
+		Bench::results.push_back({ name, bytes, iterations, mean, std::sqrt(variance), *std::min_element(runs, runs + BENCH_RUNS), exact });
+	}
+
+	// every simd kernel is checked against the scalar one on the same input before being timed
+	static inline void video() {
+		struct Kernel { const char *name; void (*p_row) (const UCHAR *p_in, UCHAR *p_out); bool supported; };
+
+		std::vector<Kernel> kernels = {
+			{ "scalar", Video::row, true },
+#ifdef SIMD_X86
+			{ "sse2", Video::row_sse2, static_cast<bool>(SDL_HasSSE2()) },
+			{ "ssse3", Video::row_ssse3, static_cast<bool>(SDL_HasSSSE3()) },
+			{ "avx2", Video::row_avx2, static_cast<bool>(SDL_HasAVX2()) },
+#endif
+#ifdef SIMD_NEON
+			{ "neon", Video::row_neon, static_cast<bool>(SDL_HasNEON()) },
+#endif
+		};
+
+		Video::p_row = Video::row;
+		Video::map(Bench::capture, Bench::reference);
+
+		for (const Kernel &kernel : kernels) {
+			if (!kernel.supported) {
+				continue;
+			}
+
+			Video::p_row = kernel.p_row;
+
+			memset(Bench::frame, 0, FRAME_SIZE_RGBA);
+			Video::map(Bench::capture, Bench::frame);
+
+			Bench::run(std::string("video_map_") + kernel.name, FRAME_SIZE_RGB + FRAME_SIZE_RGBA, !memcmp(Bench::frame, Bench::reference, FRAME_SIZE_RGBA), [] {
+				Video::map(Bench::capture, Bench::frame);
+			});
+		}
+
+		Video::p_row = Video::row;
+
+		std::vector<std::pair<const char*, uint64_t (*) (const UCHAR *p_in)>> hashes = {
+			{ "scalar", Video::hash },
+#if defined(SIMD_X86) && defined(__x86_64__)
+			{ "sse42", SDL_HasSSE42() ? Video::hash_sse42 : nullptr },
+#endif
+#if defined(SIMD_NEON) && defined(__ARM_FEATURE_CRC32)
+			{ "crc32", Video::hash_crc32 },
+#endif
+		};
+
+		for (const auto &hash : hashes) {
+			if (!hash.second) {
+				continue;
+			}
+
+			Video::p_hash = hash.second;
+
+			Bench::run(std::string("video_hash_") + hash.first, FRAME_SIZE_RGB, true, [] {
+				Video::compare(Bench::capture);
+				memset(Video::hashes, 0, sizeof(Video::hashes));
+			});
+		}
+
+		Video::p_hash = Video::hash;
+	}
+
+	// the headless colour conversion, over an unwoven frame of random pixels
+	static inline void headless() {
+		struct Kernel { const char *name; void (*p_yuv) (const UCHAR *p_in, UCHAR *p_y, UCHAR *p_u, UCHAR *p_v); bool supported; };
+
+		std::vector<Kernel> kernels = {
+			{ "scalar", Headless::yuv, true },
+#ifdef SIMD_X86
+			{ "sse2", Headless::yuv_sse2, static_cast<bool>(SDL_HasSSE2()) },
+#endif
+#ifdef SIMD_NEON
+			{ "neon", Headless::yuv_neon, static_cast<bool>(SDL_HasNEON()) },
+#endif
+		};
+
+		std::vector<UCHAR> reference(YUV_SIZE);
+		std::vector<UCHAR> converted(YUV_SIZE);
+
+		Video::p_row = Video::row;
+		Video::map(Bench::capture, Bench::frame);
+
+		Headless::p_yuv = Headless::yuv;
+		Headless::convert(Bench::frame, reference.data());
+
+		for (const Kernel &kernel : kernels) {
+			if (!kernel.supported) {
+				continue;
+			}
+
+			Headless::p_yuv = kernel.p_yuv;
+			Headless::convert(Bench::frame, converted.data());
+
+			Bench::run(std::string("headless_yuv_") + kernel.name, FRAME_SIZE_RGBA + YUV_SIZE, converted == reference, [&] {
+				Headless::convert(Bench::frame, converted.data());
+			});
+		}
+
+		Headless::p_yuv = Headless::yuv;
+	}
+
+	// two frames packed alternately as each other's difference, the second one being the capture with every eighth row
+	// changed, and every kernel has to pack them into the same bytes as the scalar ones and unpack them back exactly
+	static inline void codec() {
+		struct Kernel {
+			const char *name;
+			int (*p_residual) (const UCHAR *p_row, const UCHAR *p_ref, UCHAR *p_z, UCHAR *p_widths);
+			int (*p_pack) (const UCHAR *p_z, const UCHAR *p_widths, UCHAR *p_out);
+			void (*p_unpack) (const UCHAR *p_in, const UCHAR *p_widths, UCHAR *p_z);
+			void (*p_restore) (const UCHAR *p_z, const UCHAR *p_ref, UCHAR *p_out);
+			bool supported;
+		};
+
+		std::vector<Kernel> kernels = {
+			{ "scalar", Codec::residual, Codec::pack, Codec::unpack, Codec::restore, true },
+#ifdef SIMD_X86
+			{ "sse2", Codec::residual_sse2, Codec::pack_sse2, Codec::unpack_sse2, Codec::restore_sse2, static_cast<bool>(SDL_HasSSE2()) },
+#endif
+#ifdef SIMD_NEON
+			{ "neon", Codec::residual_neon, Codec::pack_neon, Codec::unpack_neon, Codec::restore_neon, static_cast<bool>(SDL_HasNEON()) },
+#endif
+		};
+
+		std::vector<UCHAR> frames[3] = { std::vector<UCHAR>(Bench::capture, Bench::capture + FRAME_SIZE_RGB), std::vector<UCHAR>(Bench::capture, Bench::capture + FRAME_SIZE_RGB),
+			std::vector<UCHAR>(Bench::capture, Bench::capture + FRAME_SIZE_RGB) };
+
+		for (int i = 0; i < FRAME_SIZE_RGB; i += CODEC_ROW * 8) {
+			for (int j = 0; j < CODEC_ROW; ++j) {
+				frames[1][i + j] = Bench::random();
+			}
+		}
+
+		// a camera pan or a flash, every byte of every row moving a little, which is as hard as a delta frame gets short of noise
+		for (int i = 0; i < FRAME_SIZE_RGB; ++i) {
+			frames[2][i] += Bench::random() % 17 - 8;
+		}
+
+		std::unique_ptr<Codec> p_encoder = std::make_unique<Codec>();
+		std::unique_ptr<Codec> p_decoder = std::make_unique<Codec>();
+
+		std::vector<UCHAR> reference[4];
+		std::vector<UCHAR> packed[4];
+		std::vector<UCHAR> decoded(FRAME_SIZE_RGB);
+
+		for (const Kernel &kernel : kernels) {
+			if (!kernel.supported) {
+				continue;
+			}
+
+			Codec::p_residual = kernel.p_residual;
+			Codec::p_pack = kernel.p_pack;
+			Codec::p_unpack = kernel.p_unpack;
+			Codec::p_restore = kernel.p_restore;
+
+			// a key frame, then each frame as the difference to the other, then every row changing
+			static const int order[4] = { 1, 0, 1, 2 };
+			bool exact = true;
+
+			p_encoder->reset();
+			p_decoder->reset();
+
+			for (int i = 0; i < 4; ++i) {
+				packed[i].resize(CODEC_BOUND);
+				packed[i].resize(p_encoder->encode(frames[order[i]].data(), packed[i].data(), !i));
+
+				exact = exact && p_decoder->decode(packed[i].data(), packed[i].size(), decoded.data()) && decoded == frames[order[i]];
+			}
+
+			if (reference[0].empty()) {
+				std::copy(packed, packed + 4, reference);
+			}
+
+			exact = exact && std::equal(packed, packed + 4, reference);
+
+			int frame = 0;
+			std::vector<UCHAR> out(CODEC_BOUND);
+
+			Bench::run(std::string("codec_encode_") + kernel.name, FRAME_SIZE_RGB, exact, [&] {
+				p_encoder->encode(frames[frame ^= 1].data(), out.data(), false);
+			});
+
+			// the worst cases a recording has to keep up with at 60 fps, a key frame every second and a frame where every row changed
+			Bench::run(std::string("codec_encode_key_") + kernel.name, FRAME_SIZE_RGB, exact, [&] {
+				p_encoder->encode(frames[0].data(), out.data(), true);
+			});
+
+			Bench::run(std::string("codec_encode_motion_") + kernel.name, FRAME_SIZE_RGB, exact, [&] {
+				p_encoder->encode(frames[frame = frame == 2 ? 0 : 2].data(), out.data(), false);
+			});
+
+			Bench::run(std::string("codec_decode_key_") + kernel.name, FRAME_SIZE_RGB, exact, [&] {
+				p_decoder->decode(packed[0].data(), packed[0].size(), decoded.data());
+			});
+
+			// the key frame left the decoder on the second frame, which the first one follows
+			frame = 2;
+
+			Bench::run(std::string("codec_decode_") + kernel.name, FRAME_SIZE_RGB, exact, [&] {
+				frame = frame == 2 ? 1 : 2;
+				p_decoder->decode(packed[frame].data(), packed[frame].size(), decoded.data());
+			});
+		}
+
+		Codec::p_residual = Codec::residual;
+		Codec::p_pack = Codec::pack;
+		Codec::p_unpack = Codec::unpack;
+		Codec::p_restore = Codec::restore;
+	}
+
+	static inline void audio() {
+		Bench::run("audio_map", SAMPLE_SIZE_8 * 2, true, [] {
+			Audio::map(&Bench::capture[FRAME_SIZE_RGB], Audio::buf);
+		});
+
+		struct Kernel { const char *name; void (*p_scale) (Sint16 *p_samples, int count, int from, int to); bool supported; };
+
+		std::vector<Kernel> kernels = {
+			{ "scalar", Audio::scale, true },
+#ifdef SIMD_X86
+			{ "sse2", Audio::scale_sse2, static_cast<bool>(SDL_HasSSE2()) },
+#endif
+#ifdef SIMD_NEON
+			{ "neon", Audio::scale_neon, static_cast<bool>(SDL_HasNEON()) },
+#endif
+		};
+
+		// a whole default sized callback, ramping so no kernel gets to take its steady volume shortcut
+		int count = AUDIO_FRAMES * AUDIO_CHANNELS;
+
+		std::vector<Sint16> samples(count);
+		std::vector<Sint16> reference(count);
+
+		for (int i = 0; i < count; ++i) {
+			samples[i] = Bench::random();
+		}
+
+		reference = samples;
+		Audio::scale(reference.data(), count, GAIN_UNITY, GAIN_UNITY / 4);
+
+		for (const Kernel &kernel : kernels) {
+			if (!kernel.supported) {
+				continue;
+			}
+
+			std::vector<Sint16> scaled = samples;
+			kernel.p_scale(scaled.data(), count, GAIN_UNITY, GAIN_UNITY / 4);
+
+			Bench::run(std::string("audio_gain_") + kernel.name, count * sizeof(Sint16) * 2, scaled == reference, [&] {
+				kernel.p_scale(scaled.data(), count, GAIN_UNITY, GAIN_UNITY / 4);
+			});
+		}
+	}
+
+	// the joint layout moves both screens, and the rotation changes every call so each case gets looked up
+	static inline void layout() {
+		Video::screens[Video::Screen::Type::TOP].build(Video::Screen::Type::TOP, 0, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], false);
+		Video::screens[Video::Screen::Type::BOT].build(Video::Screen::Type::BOT, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], Video::Screen::widths[Video::Screen::Crop::SCALED_DS], false);
+		Video::screens[Video::Screen::Type::JOINT].build(Video::Screen::Type::JOINT, 0, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], false);
+
+		int rotation = 0;
+
+		Bench::run("screen_move", 0, true, [&] {
+			Video::screens[Video::Screen::Type::JOINT].m_rotation = rotation = (rotation + 90) % 360;
+			Video::screens[Video::Screen::Type::JOINT].move();
+		});
+	}
+
+	static inline void config() {
+		std::string path = (std::filesystem::temp_directory_path() / (std::string(NAME) + "-bench")).string() + "/";
+		std::string name = std::string(NAME) + ".conf";
+
+		save(path, name);
+
+		Bench::run("config_load", std::filesystem::file_size(path + name), true, [&] {
+			load(path, name);
+		});
+
+		std::filesystem::remove_all(path);
+	}
+
+	static inline void print() {
+		printf("{\n\t\"benchmarks\": [\n");
+
+		for (size_t i = 0; i < Bench::results.size(); ++i) {
+			const Result &result = Bench::results[i];
+
+			printf("\t\t{ \"name\": \"%s\", \"iterations\": %llu, \"runs\": %d, \"ns_per_frame\": %.2f, \"stddev_ns\": %.2f, \"min_ns\": %.2f, \"gb_per_s\": %.3f, \"exact\": %s }%s\n",
+				result.name.c_str(), static_cast<unsigned long long>(result.iterations), BENCH_RUNS, result.mean, result.stddev, result.min,
+				result.bytes / result.mean, result.exact ? "true" : "false", i + 1 < Bench::results.size() ? "," : "");
+		}
+
+		printf("\t]\n}\n");
+	}
+
+	// a capture with random pixels and samples, the kernels not caring what they move
+	static inline void fill() {
+		for (int i = 0; i < BUF_SIZE; ++i) {
+			Bench::capture[i] = Bench::random();
+		}
+	}
+
+private:
+	static inline UCHAR capture[BUF_SIZE];
+	static inline UCHAR frame[FRAME_SIZE_RGBA];
+	static inline UCHAR reference[FRAME_SIZE_RGBA];
+
+	static inline std::mt19937 generator;
+
+	static inline int random() {
+		return static_cast<int>(Bench::generator());
+	}
+
+	template <typename Function>
+	static inline uint64_t time(Function &function, uint64_t iterations) {
+		auto start = std::chrono::steady_clock::now();
+
+		for (uint64_t i = 0; i < iterations; ++i) {
+			function();
+		}
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+int main() {
+	Bench::fill();
+
+	Bench::video();
+	Bench::headless();
+	Bench::codec();
+	Bench::audio();
+	Bench::layout();
+	Bench::config();
+
+	Bench::print();
+
+	// a kernel that doesn't match the scalar one fails the run
+	for (const Bench::Result &result : Bench::results) {
+		if (!result.exact) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
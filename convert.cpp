@@ -0,0 +1,478 @@
+/*
+* This software is provided as is, without any warranty, express or implied.
+* This software is licensed under a Creative Commons (CC BY-NC-SA) license.
+* This software is authored by Catwashere (2025).
+*/
+
+// turns a recording into a png sequence, or y4m video and wav audio, each frame drawn the way a window shows it with its
+// screen, crop and rotation, on every core at once
+#define XX3DSDL_NO_MAIN
+#define XX3DSDL_NO_DEVICE
+#include "xx3dsdl.cpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+
+// records per segment when nothing else splits them, packed recordings being split at their key frames
+#define CONVERT_SEGMENT 60
+// segments per worker the y4m and wav writer lets them get ahead of it
+#define CONVERT_AHEAD 2
+
+// a recording is cut into segments that each start where decoding can, every worker owning a deque of them and taking
+// the front of its own before stealing the front of someone else's, and the frames and samples of a segment only leave
+// once every segment before it did, so the output never depends on which worker got what
+class Convert {
+public:
+	static inline std::string png;
+	static inline std::string y4m;
+	static inline std::string wav;
+
+	static inline int type = Video::Screen::Type::JOINT;
+	static inline int crop = Video::Screen::Crop::DEFAULT_3DS;
+	static inline int rotation = 0;
+	static inline int workers = 0;
+
+	static inline bool open(std::string path) {
+		Convert::replay = std::make_unique<Replay>(path, true);
+
+		if (!Convert::replay->open()) {
+			return false;
+		}
+
+		// the canvas is the size the window would have, on its side when turned a quarter
+		int width = Convert::type == Video::Screen::Type::BOT && Convert::crop == Video::Screen::Crop::DEFAULT_3DS ?
+			Video::Screen::widths[Video::Screen::Crop::SCALED_DS] : Video::Screen::widths[Convert::crop];
+		int height = Video::Screen::heights[Convert::crop] * (Convert::type == Video::Screen::Type::JOINT ? 2 : 1);
+
+		if (Convert::rotation / 10 % 2) {
+			std::swap(width, height);
+		}
+
+		Convert::view = { Video::Layout::find(Convert::type, Convert::crop, Convert::rotation, 0, 0, 0), Convert::type, Convert::rotation - 90, width, height };
+		Convert::width = width;
+		Convert::height = height;
+
+		const Recorder::Entry *p_index = Convert::replay->p_index;
+
+		for (uint64_t i = 0; i < Convert::replay->m_count; ++i) {
+			// a short transfer is stored raw without the codec starting over, so the packed frame after it still needs the ones before
+			const UCHAR *p_payload = Convert::replay->payload(p_index[i]);
+			bool start = p_index[i].packed ? p_payload && Codec::key(p_payload) : p_index[i].read >= FRAME_SIZE_RGB;
+
+			if (Convert::segments.empty() || (start && i - Convert::segments.back().first >= CONVERT_SEGMENT)) {
+				Convert::segments.emplace_back();
+				Convert::segments.back().first = i;
+			}
+
+			Convert::segments.back().last = i + 1;
+		}
+
+		if (!Convert::png.empty()) {
+			std::error_code error;
+			std::filesystem::create_directories(Convert::png, error);
+
+			if (error) {
+				printf("[%s] Convert directory \"%s\" create failed.\n", NAME, Convert::png.c_str());
+				return false;
+			}
+		}
+
+		if (!Convert::y4m.empty()) {
+			Convert::video = ::open(Convert::y4m.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+			std::string header = "YUV4MPEG2 W" + std::to_string(Convert::width) + " H" + std::to_string(Convert::height) +
+				" F" + std::to_string(FRAMERATE_NUM) + ":" + std::to_string(FRAMERATE_DEN) + " Ip A1:1 C420jpeg\n";
+
+			if (Convert::video < 0 || !Headless::write(Convert::video, header.data(), header.size())) {
+				printf("[%s] Convert video \"%s\" open failed.\n", NAME, Convert::y4m.c_str());
+				return false;
+			}
+		}
+
+		if (!Convert::wav.empty()) {
+			Convert::audio = ::open(Convert::wav.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			Headless::Wave wave = Headless::wave(UINT32_MAX);
+
+			if (Convert::audio < 0 || !Headless::write(Convert::audio, &wave, sizeof(wave))) {
+				printf("[%s] Convert audio \"%s\" open failed.\n", NAME, Convert::wav.c_str());
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	static inline bool run() {
+		int workers = Convert::workers ? Convert::workers : std::max(1u, std::thread::hardware_concurrency());
+		workers = std::max(1, std::min<int>(workers, Convert::segments.size()));
+
+		for (int i = 0; i < workers; ++i) {
+			Convert::queues.push_back(std::make_unique<Queue>());
+		}
+
+		// dealt out in turn, so every worker starts next to the writer and the window stays full
+		for (uint64_t i = 0; i < Convert::segments.size(); ++i) {
+			Convert::queues[i % workers]->segments.push_back(i);
+		}
+
+		Convert::ahead = CONVERT_AHEAD * workers;
+
+		printf("[%s] Converting %llu records in %llu segments on %d workers.\n", NAME,
+			static_cast<unsigned long long>(Convert::replay->m_count), static_cast<unsigned long long>(Convert::segments.size()), workers);
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < workers; ++i) {
+			threads.emplace_back(Convert::work, i);
+		}
+
+		if (Convert::streaming()) {
+			Convert::drain();
+		}
+
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("[%s] Converted %llu frames in %.1f s, %.0f frames per second, %llu segments stolen.\n", NAME,
+			static_cast<unsigned long long>(Convert::frames.load()), seconds, Convert::frames / std::max(seconds, 1e-9),
+			static_cast<unsigned long long>(Convert::stolen.load()));
+
+		return !Convert::failed;
+	}
+
+	static inline void close() {
+		if (Convert::video >= 0) {
+			::close(Convert::video);
+		}
+
+		// the sizes only get known once every sample is written
+		if (Convert::audio >= 0) {
+			Headless::Wave wave = Headless::wave(Convert::written);
+
+			if (Convert::written < UINT32_MAX - sizeof(wave) && lseek(Convert::audio, 0, SEEK_SET) == 0) {
+				Headless::write(Convert::audio, &wave, sizeof(wave));
+			}
+
+			::close(Convert::audio);
+		}
+
+		if (Convert::replay) {
+			Convert::replay->close();
+		}
+	}
+
+private:
+	struct Segment {
+		uint64_t first;
+		uint64_t last;
+		bool done = false;
+
+		// the y4m frames with their markers and the wav samples, until the writer takes them
+		std::vector<UCHAR> frames;
+		std::vector<UCHAR> samples;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<uint64_t> segments;
+	};
+
+	static inline std::unique_ptr<Replay> replay;
+	static inline Video::Screenshot::View view;
+
+	static inline int width = 0;
+	static inline int height = 0;
+
+	static inline int video = -1;
+	static inline int audio = -1;
+	static inline uint64_t written = 0;
+
+	static inline std::vector<Segment> segments;
+	static inline std::vector<std::unique_ptr<Queue>> queues;
+
+	// the writer's position and the segments done are behind the one lock, which is only taken once per segment
+	static inline std::mutex mutex;
+	static inline std::condition_variable finished;
+	static inline std::condition_variable moved;
+	static inline uint64_t head = 0;
+	static inline uint64_t ahead = 0;
+	static inline std::atomic<bool> failed{false};
+
+	static inline std::atomic<uint64_t> frames{0};
+	static inline std::atomic<uint64_t> stolen{0};
+
+	static inline bool streaming() {
+		return Convert::video >= 0 || Convert::audio >= 0;
+	}
+
+	static inline void fail() {
+		{
+			std::lock_guard<std::mutex> lock(Convert::mutex);
+			Convert::failed = true;
+		}
+
+		Convert::finished.notify_all();
+		Convert::moved.notify_all();
+	}
+
+	static inline bool take(int worker, uint64_t *p_segment) {
+		for (size_t i = 0; i < Convert::queues.size(); ++i) {
+			Queue &queue = *Convert::queues[(worker + i) % Convert::queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (queue.segments.empty()) {
+				continue;
+			}
+
+			// a thief takes the segment closest to the writer too, as one further on would only wait for it
+			*p_segment = queue.segments.front();
+			queue.segments.pop_front();
+
+			if (i) {
+				++Convert::stolen;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	static inline void work(int worker) {
+		std::unique_ptr<Codec> codec = std::make_unique<Codec>();
+		std::vector<UCHAR> buf(FRAME_SIZE_RGB);
+		std::vector<UCHAR> rgba(FRAME_SIZE_RGBA);
+		std::vector<UCHAR> image(Convert::width * Convert::height * 3);
+
+		const Recorder::Entry *p_index = Convert::replay->p_index;
+		uint64_t number;
+
+		while (Convert::take(worker, &number)) {
+			// a segment that far past the writer waits for it, the one the writer is waiting on never being held up
+			if (Convert::streaming()) {
+				std::unique_lock<std::mutex> lock(Convert::mutex);
+				Convert::moved.wait(lock, [number] { return number < Convert::head + Convert::ahead || Convert::failed; });
+			}
+
+			if (Convert::failed) {
+				return;
+			}
+
+			Segment &segment = Convert::segments[number];
+			codec->reset();
+
+			for (uint64_t i = segment.first; i < segment.last; ++i) {
+				const Recorder::Entry &entry = p_index[i];
+				const UCHAR *p_payload = Convert::replay->payload(entry);
+
+				if (!p_payload) {
+					printf("[%s] Convert record %llu is corrupt.\n", NAME, static_cast<unsigned long long>(i));
+					Convert::fail();
+					return;
+				}
+
+				// a short transfer carries no frame
+				if (entry.read < FRAME_SIZE_RGB) {
+					continue;
+				}
+
+				uint32_t samples = entry.read - FRAME_SIZE_RGB;
+				const UCHAR *p_frame = p_payload;
+				const UCHAR *p_samples = p_payload + FRAME_SIZE_RGB;
+
+				if (entry.packed) {
+					if (entry.packed < samples || !codec->decode(p_payload, entry.packed, buf.data())) {
+						printf("[%s] Convert frame %llu is corrupt.\n", NAME, static_cast<unsigned long long>(i));
+						Convert::fail();
+						return;
+					}
+
+					p_frame = buf.data();
+					p_samples = p_payload + entry.packed - samples;
+				}
+
+				Video::map(const_cast<UCHAR*>(p_frame), rgba.data());
+				Video::Screenshot::compose(rgba.data(), image.data(), Convert::view);
+
+				if (!Convert::png.empty()) {
+					char name[32];
+					snprintf(name, sizeof(name), "/%08llu.png", static_cast<unsigned long long>(i));
+
+					std::string path = Convert::png + name;
+					unsigned error = lodepng_encode24_file(path.c_str(), image.data(), Convert::width, Convert::height);
+
+					if (error) {
+						printf("[%s] Convert \"%s\" save failed: %s\n", NAME, path.c_str(), lodepng_error_text(error));
+						Convert::fail();
+						return;
+					}
+				}
+
+				if (Convert::video >= 0) {
+					static const char marker[] = "FRAME\n";
+					size_t size = segment.frames.size();
+
+					segment.frames.resize(size + sizeof(marker) - 1 + Convert::width * Convert::height * 3 / 2);
+					memcpy(&segment.frames[size], marker, sizeof(marker) - 1);
+
+					Convert::yuv(image.data(), &segment.frames[size + sizeof(marker) - 1]);
+				}
+
+				if (Convert::audio >= 0) {
+					segment.samples.insert(segment.samples.end(), p_samples, p_samples + std::min<uint32_t>(samples, SAMPLE_SIZE_8));
+				}
+
+				++Convert::frames;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(Convert::mutex);
+				segment.done = true;
+			}
+
+			Convert::finished.notify_all();
+		}
+	}
+
+	// the segments leave in order, each one's memory going back as soon as it's written
+	static inline void drain() {
+		for (uint64_t i = 0; i < Convert::segments.size(); ++i) {
+			Segment &segment = Convert::segments[i];
+
+			{
+				std::unique_lock<std::mutex> lock(Convert::mutex);
+				Convert::finished.wait(lock, [&segment] { return segment.done || Convert::failed; });
+
+				if (Convert::failed) {
+					return;
+				}
+			}
+
+			if (Convert::video >= 0 && !Headless::write(Convert::video, segment.frames.data(), segment.frames.size())) {
+				printf("[%s] Convert video write failed.\n", NAME);
+				Convert::fail();
+				return;
+			}
+
+			if (Convert::audio >= 0 && !Headless::write(Convert::audio, segment.samples.data(), segment.samples.size())) {
+				printf("[%s] Convert audio write failed.\n", NAME);
+				Convert::fail();
+				return;
+			}
+
+			Convert::written += segment.samples.size();
+
+			std::vector<UCHAR>().swap(segment.frames);
+			std::vector<UCHAR>().swap(segment.samples);
+
+			{
+				std::lock_guard<std::mutex> lock(Convert::mutex);
+				Convert::head = i + 1;
+			}
+
+			Convert::moved.notify_all();
+		}
+	}
+
+	// the same 4:2:0 bt.601 limited range Headless::yuv gives, on the rgb canvas
+	static inline void yuv(const UCHAR *p_in, UCHAR *p_out) {
+		int width = Convert::width;
+		UCHAR *p_y = p_out;
+		UCHAR *p_u = p_y + width * Convert::height;
+		UCHAR *p_v = p_u + width * Convert::height / 4;
+
+		for (int i = 0; i < Convert::height; i += 2) {
+			for (int j = 0; j < width; j += 2) {
+				int r = 0;
+				int g = 0;
+				int b = 0;
+
+				for (int row = i; row < i + 2; ++row) {
+					for (int column = j; column < j + 2; ++column) {
+						const UCHAR *p_pixel = &p_in[3 * (width * row + column)];
+
+						p_y[width * row + column] = ((66 * p_pixel[0] + 129 * p_pixel[1] + 25 * p_pixel[2] + 128) >> 8) + 16;
+
+						r += p_pixel[0];
+						g += p_pixel[1];
+						b += p_pixel[2];
+					}
+				}
+
+				r = (r + 2) >> 2;
+				g = (g + 2) >> 2;
+				b = (b + 2) >> 2;
+
+				p_u[width / 2 * (i / 2) + j / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+				p_v[width / 2 * (i / 2) + j / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+			}
+		}
+	}
+};
+
+int main(int argc, char **argv) {
+	const char *path = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--png") == 0 && i + 1 < argc) {
+			Convert::png = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--y4m") == 0 && i + 1 < argc) {
+			Convert::y4m = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+			Convert::wav = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--screen") == 0 && i + 1 < argc && Video::screen(argv[i + 1])) {
+			Convert::type = Video::screen(argv[++i]) - Video::screens;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--crop") == 0 && i + 1 < argc) {
+			Convert::crop = std::max(0, std::min<int>(Video::Screen::Crop::COUNT - 1, atoi(argv[++i])));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--rotation") == 0 && i + 1 < argc) {
+			Convert::rotation = (atoi(argv[++i]) / 90 * 90 % 360 + 360) % 360;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			Convert::workers = std::max(1, atoi(argv[++i]));
+			continue;
+		}
+
+		if (!path && argv[i][0] != '-') {
+			path = argv[i];
+			continue;
+		}
+
+		printf("[%s] Invalid argument \"%s\".\n", NAME, argv[i]);
+		return 1;
+	}
+
+	if (!path || (Convert::png.empty() && Convert::y4m.empty() && Convert::wav.empty())) {
+		printf("[%s] Usage: xx3dsdl-convert <recording> [--png <dir>] [--y4m <file>] [--wav <file>] [--screen top|bot|joint] [--crop 0-2] [--rotation 0|90|180|270] [--threads <n>]\n", NAME);
+		return 1;
+	}
+
+	Video::dispatch();
+	Codec::dispatch();
+
+	bool done = Convert::open(path) && Convert::run();
+	Convert::close();
+
+	return done ? 0 : 1;
+}
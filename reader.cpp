@@ -0,0 +1,107 @@
+/*
+* This software is provided as is, without any warranty, express or implied.
+* This software is licensed under a Creative Commons (CC BY-NC-SA) license.
+* This software is authored by Catwashere (2025).
+*/
+
+// reference reader for the --shm frame ring, using every frame in place and printing how many it got, missed and saw
+// torn every second, along with how old the latest one was by the time it got to it
+#include "shm.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NAME "xx3dsdl-reader"
+
+static uint64_t now() {
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+	std::string name = argc > 1 ? argv[1] : "/xx3dsdl";
+
+	if (name[0] != '/') {
+		name = "/" + name;
+	}
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fd < 0) {
+		printf("[%s] Ring \"%s\" open failed, is xx3dsdl running with --shm?\n", NAME, name.c_str());
+		return 1;
+	}
+
+	void *p_map = mmap(nullptr, sizeof(Shm::Header), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (p_map == MAP_FAILED) {
+		printf("[%s] Ring \"%s\" map failed.\n", NAME, name.c_str());
+		return 1;
+	}
+
+	const Shm::Header *p_header = static_cast<const Shm::Header*>(p_map);
+
+	if (!Shm::compatible(p_header)) {
+		printf("[%s] Ring \"%s\" is not a compatible frame ring.\n", NAME, name.c_str());
+		return 1;
+	}
+
+	uint64_t seen = UINT64_MAX;
+	uint64_t frames = 0;
+	uint64_t missed = 0;
+	uint64_t torn = 0;
+	uint64_t age = 0;
+	uint64_t checksum = 0;
+	uint64_t reported = now();
+
+	while (true) {
+		uint64_t sequence;
+		const Shm::Slot *p_slot = Shm::latest(p_header, seen, &sequence);
+
+		if (!p_slot) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		else {
+			uint64_t frame = p_slot->frame;
+
+			// a real consumer would upload the pixels from here, this one just reads the first row of them
+			for (int i = 0; i < SHM_WIDTH * 4; ++i) {
+				checksum += p_slot->pixels[i];
+			}
+
+			if (!Shm::valid(p_slot, sequence)) {
+				++torn;
+			}
+
+			else {
+				missed += seen == UINT64_MAX ? 0 : frame - seen - 1;
+				age = now() - p_slot->time;
+				++frames;
+			}
+
+			seen = frame;
+		}
+
+		if (now() - reported >= 1000000000) {
+			printf("[%s] %llu frames, %llu missed, %llu torn, latest %.2f ms old (%llu)\n", NAME,
+				static_cast<unsigned long long>(frames), static_cast<unsigned long long>(missed), static_cast<unsigned long long>(torn),
+				age / 1e6, static_cast<unsigned long long>(checksum & 0xff));
+
+			frames = missed = torn = 0;
+			reported = now();
+		}
+	}
+
+	return 0;
+}
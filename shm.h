@@ -0,0 +1,89 @@
+/*
+* This software is provided as is, without any warranty, express or implied.
+* This software is licensed under a Creative Commons (CC BY-NC-SA) license.
+* This software is authored by Catwashere (2025).
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#define SHM_VERSION 1
+#define SHM_SLOTS 8
+
+#define SHM_WIDTH 240
+#define SHM_HEIGHT 720
+
+#define SHM_FRAME_SIZE (SHM_WIDTH * SHM_HEIGHT * 4)
+#define SHM_AUDIO_SIZE 2192
+#define SHM_RATE 32734
+#define SHM_CHANNELS 2
+
+// the ring xx3dsdl publishes every unwoven frame and its audio into with --shm. it never waits on a reader, so a reader
+// uses a slot in place and only trusts what it got if the slot's sequence is still the one it started with
+class Shm {
+public:
+	static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+	static inline const char magic[8] = { 'X', 'X', '3', 'D', 'S', 'S', 'H', 'M' };
+
+	struct Slot {
+		// odd while the slot is being written
+		std::atomic<uint64_t> sequence;
+
+		uint64_t frame;
+		// CLOCK_MONOTONIC nanoseconds of when the transfer was taken
+		uint64_t time;
+		uint32_t audio;
+		uint32_t reserved;
+
+		// rgba rows of 240 pixels, the top screen's 400 above the bottom screen's 320, then 16 bit stereo samples at 32734 hz
+		alignas(64) unsigned char pixels[SHM_FRAME_SIZE];
+		unsigned char samples[SHM_AUDIO_SIZE];
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t slots;
+		uint32_t width;
+		uint32_t height;
+		uint32_t rate;
+		uint32_t channels;
+
+		// frames published so far, the latest one being in slot (published - 1) % slots
+		alignas(64) std::atomic<uint64_t> published;
+
+		alignas(64) Slot slot[SHM_SLOTS];
+	};
+
+	static inline bool compatible(const Header *p_header) {
+		return !memcmp(p_header->magic, Shm::magic, sizeof(Shm::magic)) && p_header->version == SHM_VERSION && p_header->slots == SHM_SLOTS &&
+			p_header->width == SHM_WIDTH && p_header->height == SHM_HEIGHT && p_header->rate == SHM_RATE && p_header->channels == SHM_CHANNELS;
+	}
+
+	// the latest frame when it is newer than the one last seen, along with the sequence to check it against once used
+	static inline const Slot *latest(const Header *p_header, uint64_t seen, uint64_t *p_sequence) {
+		uint64_t published = p_header->published.load(std::memory_order_acquire);
+
+		if (!published || published - 1 == seen) {
+			return nullptr;
+		}
+
+		const Slot *p_slot = &p_header->slot[(published - 1) % SHM_SLOTS];
+		*p_sequence = p_slot->sequence.load(std::memory_order_acquire);
+
+		if (*p_sequence & 1 || p_slot->frame != published - 1) {
+			return nullptr;
+		}
+
+		return p_slot;
+	}
+
+	static inline bool valid(const Slot *p_slot, uint64_t sequence) {
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		return p_slot->sequence.load(std::memory_order_relaxed) == sequence;
+	}
+};
@@ -4,7 +4,13 @@
 * This software is authored by Catwashere (2025).
 */
 
+// the offline tools only ever replay recordings, so they build without the d3xx driver
+#ifdef XX3DSDL_NO_DEVICE
+typedef unsigned char UCHAR;
+typedef unsigned long ULONG;
+#else
 #include <ftd3xx/ftd3xx.h>
+#endif
 
  // using lodepng to load a png image instead of the default SDL2_image to avoid the need to add another dependency
 #include "lodepng.h"
@@ -17,18 +23,48 @@
 #include <GL/gl.h>
 #endif
 
+// the simd kernels are compiled per function for their instruction set and picked at runtime from what the cpu supports
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
 #include <cstring>
+#include <ctime>
+#include <chrono>
 #include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <future>
 #include <sstream>
 #include <thread>
-#include <queue>
 #include <algorithm>
 #include <map>
+#include <new>
+#include <vector>
+#include <tuple>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "execpath.h"
+#include "shm.h"
 
 #define NAME "xx3dsdl"
 
@@ -60,17 +96,78 @@
 #define BUF_COUNT 8
 #define BUF_SIZE (FRAME_SIZE_RGB + SAMPLE_SIZE_8)
 
+// only half the ring is ever queued on the device, the other half holding the latest completed transfers for the consumers to read
+#define BUF_PENDING (BUF_COUNT / 2)
+#define BUF_HELD (BUF_COUNT - BUF_PENDING)
+
 #define FRAMERATE_LIMIT 60
 
-#define SAMPLE_LIMIT 3
-#define DROP_LIMIT 3
+// the 3ds itself refreshes at about 59.83 fps, which headless video is stamped with
+#define FRAMERATE_NUM 268111856
+#define FRAMERATE_DEN 4481136
+
+#define YUV_SIZE (CAP_RES * 3 / 2)
+
+#define AUDIO_RATE 48000
+#define AUDIO_TARGET 40
+
+#define GAIN_UNITY (1 << 15)
+#define GAIN_BLOCK 8
+
+#define AUDIO_FRAMES 1024
+#define AUDIO_FRAMES_MIN 64
+#define AUDIO_FRAMES_MAX 8192
+#define AUDIO_FRAMES_AUTO 256
+
+#define UNDERRUN_LIMIT 3
+#define UNDERRUN_WINDOW 10000
+// a transfer arriving this many ms after the previous one means the capture stalled or reconnected
+#define UNDERRUN_STALL 50
+
+#define RING_SIZE 32768
+#define CACHE_LINE 64
 
 #define TRANSFER_ABORT -1
 
+#define STATS_INTERVAL 5000
+
+// about two seconds of transfers can wait on the disk before any get dropped
+#define RECORD_SLOTS 128
+#define RECORD_BUFFER (8 * 1024 * 1024)
+
+// a burst is 30 frames unless set otherwise, and eight frames can wait on the encoders before any get skipped
+#define SCREENSHOT_BURST 30
+#define SCREENSHOT_SLOTS 8
+#define SCREENSHOT_WORKERS 4
+
+// fast forwarding doubles up to 8x, and jumps are 10 seconds of recording
+#define REPLAY_SPEED_MAX 8
+#define REPLAY_JUMP 10000000000LL
+
+// eight socket clients, each queueing four transfers unless it asks for up to 16, sharing 32 copies between them
+#define SERVER_CLIENTS 8
+#define SERVER_DEPTH 4
+#define SERVER_DEPTH_MAX 16
+#define SERVER_FRAMES 32
+#define SERVER_BUFFER (4 * 1024 * 1024)
+
+// the codec packs each raw row of 720 bytes as 45 blocks of 16, with a key frame every second in recordings and clips
+#define CODEC_ROW (CAP_WIDTH * 3)
+#define CODEC_BLOCKS (CODEC_ROW / 16)
+#define CODEC_WIDTHS ((CODEC_BLOCKS + 1) / 2)
+#define CODEC_TYPES (CAP_HEIGHT / 4)
+#define CODEC_KEY 60
+#define CODEC_BOUND (1 + CODEC_TYPES + CAP_HEIGHT * (CODEC_WIDTHS + CODEC_ROW))
+
+// clips fit in 192 MB unless told otherwise
+#define CLIP_MEMORY 192
+#define CLIP_BOUND (CODEC_BOUND + SAMPLE_SIZE_8)
+
 const std::string CONF_DIR = std::string(std::getenv("HOME")) + "/.config/" + std::string(NAME) + "/";
 
-bool g_running = true;
-bool g_finished = false;
+// cleared from the signal handlers too, which only async signal safe lock-free atomics may be
+std::atomic<bool> g_running{true};
+static_assert(std::atomic<bool>::is_always_lock_free);
 
 bool g_safe_mode = false;
 
@@ -79,1322 +176,5227 @@ bool g_kmsdrm = false;
 SDL_Rect g_display_bounds[2] = {};
 int g_numdisplays = 0;
 
-class Capture {
+// a source fills the capture ring one transfer at a time, the ftdi device being the default one
+class Source {
 public:
-	static inline UCHAR buf[BUF_COUNT][BUF_SIZE];
-	static inline ULONG read[BUF_COUNT];
+	virtual ~Source() {}
 
-	static inline bool starting = true;
+	virtual bool open() = 0;
+	virtual void close() = 0;
+	virtual bool arm(int index) = 0;
+	virtual bool wait(int index) = 0;
+};
 
-	static inline bool connected = false;
-	static inline bool disconnecting = false;
+// hands completed transfers from the capture thread to a consumer without locks or allocations, every transfer being
+// numbered so the consumer can tell which ones it missed and whether a buffer got refilled while it was reading it
+class Mailbox {
+public:
+	enum Policy { LATEST, EVERY };
 
-	static inline bool auto_connect = false;
+	uint64_t m_drops = 0;
+	uint64_t m_overruns = 0;
 
-	static inline bool connect() {
-		if (Capture::connected) {
-			return true;
-		}
+	Mailbox(Policy policy) : m_policy(policy), m_semaphore(SDL_CreateSemaphore(0)) {}
 
-		if (FT_Create(const_cast<char*>(PRODUCT_1), FT_OPEN_BY_DESCRIPTION, &Capture::handle) && FT_Create(const_cast<char*>(PRODUCT_2), FT_OPEN_BY_DESCRIPTION, &Capture::handle)) {
-			printf("[%s] Create failed.\n", NAME);
-			return false;
-		}
+	~Mailbox() {
+		SDL_DestroySemaphore(this->m_semaphore);
+	}
 
-		UCHAR buf[4] = {0x40, 0x80, 0x00, 0x00};
-		ULONG written = 0;
+	static inline void publish(int index) {
+		uint64_t published = Mailbox::published.load(std::memory_order_relaxed);
 
-		FT_AbortPipe(Capture::handle, BULK_OUT);
-		FT_AbortPipe(Capture::handle, BULK_IN);
-		FT_FlushPipe(Capture::handle, BULK_OUT);
-		FT_FlushPipe(Capture::handle, BULK_IN);
-		FT_ClearStreamPipe(Capture::handle, false, false, BULK_IN);
-		FT_ClearStreamPipe(Capture::handle, false, false, BULK_OUT);
+		Mailbox::sequences[index].store(published, std::memory_order_release);
+		Mailbox::published.store(published + 1, std::memory_order_release);
+	}
 
-		if (FT_WritePipe(Capture::handle, BULK_OUT, buf, 4, &written, 0)) {
-			printf("[%s] Write failed.\n", NAME);
-			return false;
-		}
-		
-		UCHAR buf2[16] = {0x98, 0x05, 0x9f, 0x0};
-		ULONG returned = 0;
-		
-		if (FT_WritePipe(handle, BULK_OUT, buf2, 4, &returned, 0)) {
-			printf("[%s] Write bsId failed.\n", NAME);
-			return false;
-		}
+	// the fence keeps the refill that follows from being seen before the slot stopped holding its transfer, which release()
+	// relies on to tell a torn read
+	static inline void arm(int index) {
+		Mailbox::sequences[index].store(Mailbox::ARMED, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
 
-		if (FT_ReadPipe(handle, BULK_IN, buf2, 16, &returned, 0)) {
-			printf("[%s] Read bsId failed.\n", NAME);
-			return false;
-		}
+	// every connection starts on a whole lap of the ring so a transfer's slot is always its sequence number modulo the ring size
+	static inline void restart() {
+		uint64_t published = (Mailbox::published.load() + BUF_COUNT - 1) / BUF_COUNT * BUF_COUNT;
 
-		uint32_t bsId = (((((buf2[4] << 8) | buf2[3]) << 8) | buf2[2]) << 8) | buf2[1];
-		if((bsId & 0xf0f0ff) != 0xc0b0a1){
-			printf("[%s] bsId validation failed\n", NAME);
-			return false;
+		for (int i = 0; i < BUF_COUNT; ++i) {
+			Mailbox::arm(i);
 		}
 
-		buf[1] = 0x00;
+		Mailbox::first.store(published);
+		Mailbox::published.store(published);
+	}
 
-		if (FT_WritePipe(Capture::handle, BULK_OUT, buf, 4, &written, 0)) {
-			printf("[%s] Write failed.\n", NAME);
-			return false;
+	// a consumer that keeps up never waits, so posting every transfer would pile up a count it then has to spin through.
+	// one pending post is enough to wake it, and it checks what was published again before it waits
+	void notify() {
+		if (!SDL_SemValue(this->m_semaphore)) {
+			SDL_SemPost(this->m_semaphore);
 		}
+	}
 
-		if (FT_SetStreamPipe(Capture::handle, false, false, BULK_IN, BUF_SIZE)) {
-			printf("[%s] Stream failed.\n", NAME);
-			return false;
-		}
+	// returns the slot to read, or TRANSFER_ABORT when nothing new arrived within the timeout
+	int take(Uint32 timeout) {
+		this->m_next = std::max(this->m_next, Mailbox::first.load());
 
-		for (int i = 0; i < BUF_COUNT; ++i) {
-			if (FT_InitializeOverlapped(Capture::handle, &Capture::overlap[i])) {
-				printf("[%s] Initialize failed.\n", NAME);
-				return false;
-			}
-		}
+		uint64_t published;
 
-		for (int i = 0; i < BUF_COUNT; ++i) {
-			if (FT_ReadPipeAsync(Capture::handle, FIFO_CHANNEL, Capture::buf[i], BUF_SIZE, &Capture::read[i], &Capture::overlap[i]) != FT_IO_PENDING) {
-				printf("[%s] Read failed.\n", NAME);
-				return false;
+		while ((published = Mailbox::published.load(std::memory_order_acquire)) <= this->m_next) {
+			if (SDL_SemWaitTimeout(this->m_semaphore, timeout)) {
+				return TRANSFER_ABORT;
 			}
+
+			this->m_next = std::max(this->m_next, Mailbox::first.load());
 		}
 
-		return true;
-	}
+		// video only wants the freshest transfer, audio wants every one that hasn't been handed back to the device yet
+		uint64_t sequence = this->m_policy == Mailbox::Policy::LATEST ? published - 1 : std::max(this->m_next, published - std::min<uint64_t>(published, BUF_HELD));
 
-	static inline void stream(std::promise<int> *p_audio_promise, std::promise<int> *p_video_promise, bool *p_audio_waiting, bool *p_video_waiting) {
-		while (g_running) {
-			if (!Capture::connected) {
-				if (Capture::auto_connect) {
-					if (!(Capture::connected = Capture::connect())) {
-						SDL_Delay(5000);
-					}
-				}
+		this->m_drops += sequence - this->m_next;
+		this->m_sequence = sequence;
+		this->m_next = sequence + 1;
 
-				else {
-					SDL_Delay(5);
-				}
+		if (Mailbox::sequences[sequence % BUF_COUNT].load(std::memory_order_acquire) != sequence) {
+			++this->m_overruns;
+			return TRANSFER_ABORT;
+		}
 
-				continue;
-			}
+		return sequence % BUF_COUNT;
+	}
 
-			if (Capture::disconnecting || !Capture::transfer()) {
-				Capture::disconnecting = Capture::connected = Capture::disconnect();
-				Capture::signal(p_video_promise, p_video_waiting, TRANSFER_ABORT);
+	// false when the slot was handed back to the device while it was being read
+	bool release() {
+		std::atomic_thread_fence(std::memory_order_acquire);
 
-				Capture::starting = true;
-				Capture::index = 0;
+		if (Mailbox::sequences[this->m_sequence % BUF_COUNT].load(std::memory_order_relaxed) == this->m_sequence) {
+			return true;
+		}
 
-				continue;
-			}
+		++this->m_overruns;
+		return false;
+	}
 
-			Capture::signal(p_audio_promise, p_audio_waiting, Capture::index);
-			Capture::signal(p_video_promise, p_video_waiting, Capture::index);
+private:
+	static constexpr uint64_t ARMED = UINT64_MAX;
 
-			Capture::index = (Capture::index + 1) % BUF_COUNT;
+	static inline std::atomic<uint64_t> sequences[BUF_COUNT];
+	static inline std::atomic<uint64_t> published{0};
+	static inline std::atomic<uint64_t> first{0};
 
-			if (Capture::starting) {
-				Capture::starting = Capture::index;
-			}
-		}
+	Policy m_policy;
+	SDL_sem *m_semaphore;
 
-		Capture::disconnecting = Capture::connected = Capture::disconnect();
+	uint64_t m_next = 0;
+	uint64_t m_sequence = 0;
+};
 
-		while (!g_finished) {
-			Capture::signal(p_audio_promise, p_audio_waiting, TRANSFER_ABORT);
-			Capture::signal(p_video_promise, p_video_waiting, TRANSFER_ABORT);
+// lock-free log scale histogram, every power of two being split in four buckets so percentiles land within a quarter of their value
+class Histogram {
+public:
+	void add(uint64_t value) {
+		this->m_buckets[Histogram::bucket(value)].fetch_add(1, std::memory_order_relaxed);
+		this->m_count.fetch_add(1, std::memory_order_relaxed);
 
-			SDL_Delay(5);
-		}
-	}
+		uint64_t max = this->m_max.load(std::memory_order_relaxed);
 
-private:
-	static inline FT_HANDLE handle;
-	static inline OVERLAPPED overlap[BUF_COUNT];
+		while (value > max && !this->m_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+	}
 
-	static inline int index = 0;
+	uint64_t count() const {
+		return this->m_count.load(std::memory_order_relaxed);
+	}
 
-	static inline bool disconnect() {
-		if (!Capture::connected) {
-			return false;
-		}
+	uint64_t max() const {
+		return this->m_max.load(std::memory_order_relaxed);
+	}
 
-		if (Capture::handle == nullptr) {
-			printf("[%s] Handle is null, skipping disconnect.\n", NAME);
-			return false;
-		}
-		SDL_Delay(100);
+	// upper bound of the bucket holding the given fraction of the samples
+	uint64_t percentile(double fraction) const {
+		uint64_t rank = std::max<uint64_t>(1, std::ceil(this->count() * fraction));
+		uint64_t seen = 0;
 
-		for (int i = 0; i < BUF_COUNT; ++i) {
-			if (FT_ReleaseOverlapped(Capture::handle, &Capture::overlap[i])) {
-				printf("[%s] Release failed.\n", NAME);
+		for (int i = 0; i < Histogram::SIZE; ++i) {
+			if ((seen += this->m_buckets[i].load(std::memory_order_relaxed)) >= rank) {
+				return std::min(Histogram::upper(i), this->max());
 			}
 		}
 
-		SDL_Delay(50);
-		
-		if (FT_Close(Capture::handle)) {
-			printf("[%s] Close failed.\n", NAME);
-		}
-		
-		return false;
+		return this->max();
 	}
 
-	static inline bool transfer() {
-		if (FT_GetOverlappedResult(Capture::handle, &Capture::overlap[Capture::index], &Capture::read[Capture::index], true) == FT_IO_INCOMPLETE && FT_AbortPipe(Capture::handle, BULK_IN)) {
-			printf("[%s] Abort failed.\n", NAME);
-			return false;
-		}
+private:
+	static constexpr int SPLIT = 2;
+	static constexpr int SIZE = 64 << SPLIT;
 
-		if (FT_ReadPipeAsync(Capture::handle, FIFO_CHANNEL, Capture::buf[Capture::index], BUF_SIZE, &Capture::read[Capture::index], &Capture::overlap[Capture::index]) != FT_IO_PENDING) {
-			printf("[%s] Read failed.\n", NAME);
-			return false;
+	static inline int bucket(uint64_t value) {
+		if (value < (1 << SPLIT)) {
+			return value;
 		}
 
-		return true;
+		int msb = 63 - __builtin_clzll(value);
+
+		return (msb - SPLIT + 1) << SPLIT | (value >> (msb - SPLIT) & ((1 << SPLIT) - 1));
 	}
 
-	static inline void signal(std::promise<int> *p_promise, bool *p_waiting, int value) {
-		if (*p_waiting) {
-			*p_waiting = false;
-			p_promise->set_value(value);
+	static inline uint64_t upper(int bucket) {
+		if (bucket < (1 << SPLIT)) {
+			return bucket;
 		}
+
+		int shift = (bucket >> SPLIT) - 1;
+
+		return (((uint64_t)(1 << SPLIT | (bucket & ((1 << SPLIT) - 1))) + 1) << shift) - 1;
 	}
+
+	std::atomic<uint64_t> m_buckets[SIZE] = {};
+	std::atomic<uint64_t> m_count{0};
+	std::atomic<uint64_t> m_max{0};
 };
 
-class Audio {
+// per stage timings of the pipeline, from the usb transfer completing to the frame being presented, every hook being a single
+// branch when the stats are off
+class Stats {
 public:
-	static inline Audio *p_audio;
+	static inline bool enabled = false;
+
+	static inline Histogram usb;
+	static inline Histogram queue;
+	static inline Histogram map;
+	static inline Histogram load;
+	static inline Histogram present;
+	static inline Histogram latency;
+	static inline Histogram ring;
+
+	static inline uint64_t now() {
+		if (!Stats::enabled) {
+			return 0;
+		}
 
-	static inline int volume = 100;
-	static inline bool mute = false;
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
-	static inline std::promise<int> promise;
-	static inline bool waiting = false;
+	// records the time since the previous stage ended and returns the time this one did, so stages chain
+	static inline uint64_t stage(Histogram &histogram, uint64_t from) {
+		if (!Stats::enabled) {
+			return 0;
+		}
 
-	static inline SDL_AudioDeviceID device_id;
-	static inline SDL_AudioSpec audio_spec;
+		uint64_t now = Stats::now();
+		histogram.add(now - from);
 
-	Audio() {
-		SDL_AudioSpec wanted_spec;
-		SDL_memset(&wanted_spec, 0, sizeof(wanted_spec));
-		wanted_spec.freq = SAMPLE_RATE;
-		wanted_spec.format = AUDIO_S16SYS;
-		wanted_spec.channels = AUDIO_CHANNELS;
-		wanted_spec.samples = 1024;
-		wanted_spec.callback = audio_callback;
-		wanted_spec.userdata = this;
+		return now;
+	}
 
-		device_id = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &audio_spec, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
-		if (device_id == 0) {
-			printf("[%s] SDL_OpenAudioDevice failed: %s\n", NAME, SDL_GetError());
+	static inline void complete(int index) {
+		if (!Stats::enabled) {
 			return;
 		}
 
-		SDL_PauseAudioDevice(device_id, 0);
-		SDL_Delay(100);  // Give time for callback to be called
-	}
-
-	static inline void playback() {
-		while (g_running) {
-			Audio::promise = std::promise<int>();
-			Audio::waiting = true;
+		uint64_t now = Stats::now();
 
-			int ready = Audio::promise.get_future().get();
+		if (Stats::completed_last) {
+			Stats::usb.add(now - Stats::completed_last);
+		}
 
-			if (ready == TRANSFER_ABORT) {
-				continue;
-			}
+		Stats::completed_last = now;
+		Stats::completed[index].store(now, std::memory_order_relaxed);
+	}
 
-			if (Capture::starting) {
-				Audio::reset();
-				continue;
-			}
+	static inline uint64_t completion(int index) {
+		return Stats::completed[index].load(std::memory_order_relaxed);
+	}
 
-			if (!Audio::load(&Capture::buf[ready][FRAME_SIZE_RGB], &Capture::read[ready])) {
-				continue;
-			}
+	// a frame is late when it reaches the screen more than a frame after its transfer completed, and every frame period
+	// that passes without a new one means the previous frame got shown again
+	static inline void presented(uint64_t uploaded, uint64_t completed) {
+		if (!Stats::enabled) {
+			return;
+		}
 
-			Audio::index = (Audio::index + 1) % BUF_COUNT;
+		uint64_t now = Stats::stage(Stats::present, uploaded);
 
-			if (Audio::starting) {
-				Audio::starting = false; 
-			}
+		Stats::latency.add(now - completed);
+		Stats::late += now - completed > Stats::PERIOD;
 
-			Audio::unblock();
+		if (Stats::presented_last) {
+			Stats::duplicated += std::max<uint64_t>(1, (now - Stats::presented_last + Stats::PERIOD / 2) / Stats::PERIOD) - 1;
 		}
 
-		Audio::unblock();
-		delete Audio::p_audio;
+		Stats::presented_last = now;
+		++Stats::frames;
 	}
 
-	static inline void audio_callback(void *userdata, Uint8 *stream, int len) {
-		Audio *audio = static_cast<Audio*>(userdata);
-
-		int samples_needed = len / sizeof(Sint16);
-		Sint16 *output = reinterpret_cast<Sint16*>(stream);
-		int samples_written = 0;
+	// nothing gets presented while the capture is down, which should not count as the last frame being shown again
+	static inline void idle() {
+		Stats::presented_last = 0;
+	}
 
-		float volumeLevel = Audio::volume / 100.0f;
-		if (Audio::mute) {
-			// not droping audio when muted to avoid audio noise when unmuting
-			volumeLevel = 0;
-		}else{
-			// non linear volume
-			volumeLevel *= volumeLevel;
+	// a frame identical to the one on screen isn't presented, the screen already showing it being no duplicate either
+	static inline void unchanged() {
+		if (!Stats::enabled) {
+			return;
 		}
 
-		while (samples_written < samples_needed && !Audio::samples.empty()) {
-			Audio::Sample& sample = Audio::samples.front();
-			int samples_to_copy = std::min(samples_needed - samples_written, 
-										static_cast<int>(sample.size - sample.offset));
-			
-			for (int i = 0; i < samples_to_copy; ++i) {
-				output[samples_written + i] = static_cast<Sint16>(sample.bytes[sample.offset + i] * volumeLevel);
-			}
-			
-			sample.offset += samples_to_copy;
-			samples_written += samples_to_copy;
-			
-			if (sample.offset >= sample.size) {
-				Audio::samples.pop();
-			}
-		}
+		Stats::presented_last = Stats::now();
+	}
 
-		// Fill remaining with silence if needed
-		if (samples_written < samples_needed) {
-			SDL_memset(output + samples_written, 0, (samples_needed - samples_written) * sizeof(Sint16));
+	// frames that differ from the previous one give the rate the game actually renders at
+	static inline void captured(bool changed) {
+		if (!Stats::enabled) {
+			return;
 		}
-		
-		// Don't call unblock here - it's causing issues
-		// Audio::unblock();
+
+		++Stats::captures;
+		Stats::changes += changed;
 	}
 
-private:
-	struct Sample {
-		Sample(Sint16 *bytes, std::size_t size) : bytes(bytes), size(size), offset(0) {}
+	static inline void tick(const Mailbox *p_mailbox) {
+		if (!Stats::enabled || SDL_GetTicks() - Stats::reported < STATS_INTERVAL) {
+			return;
+		}
 
-		Sint16 *bytes;
-		std::size_t size;
-		std::size_t offset;
-	};
+		Stats::report(p_mailbox);
+	}
 
-	static inline Sint16 buf[BUF_COUNT][SAMPLE_SIZE_16];
-	static inline std::queue<Audio::Sample> samples;
+	static inline void report(const Mailbox *p_mailbox) {
+		if (!Stats::enabled) {
+			return;
+		}
 
-	static inline bool starting = true;
+		printf("[%s] Stats after %u s:\n", NAME, SDL_GetTicks() / 1000);
 
-	static inline int index = 0;
-	static inline int drops = 0;
+		Stats::print("usb", Stats::usb);
+		Stats::print("queue", Stats::queue);
+		Stats::print("map", Stats::map);
+		Stats::print("load", Stats::load);
+		Stats::print("present", Stats::present);
+		Stats::print("latency", Stats::latency);
 
-	static inline std::promise<void> barrier;
-	static inline bool blocked = false;
+		printf("[%s]   %-8s p50 %6llu  p99 %6llu  max %6llu frames (%llu)\n", NAME, "ring",
+			static_cast<unsigned long long>(Stats::ring.percentile(0.50)), static_cast<unsigned long long>(Stats::ring.percentile(0.99)),
+			static_cast<unsigned long long>(Stats::ring.max()), static_cast<unsigned long long>(Stats::ring.count()));
 
-	static inline void reset() {
-		Audio::unblock();
-		delete Audio::p_audio;
+		printf("[%s]   %llu frames presented, %llu dropped, %llu duplicated, %llu late\n", NAME, static_cast<unsigned long long>(Stats::frames),
+			static_cast<unsigned long long>(p_mailbox->m_drops + p_mailbox->m_overruns), static_cast<unsigned long long>(Stats::duplicated),
+			static_cast<unsigned long long>(Stats::late));
 
-		Audio::samples = {};
-		Audio::p_audio = new Audio();
+		// the source rate covers the time since the previous report so it follows the game as it changes
+		Uint32 now = SDL_GetTicks();
 
-		Audio::starting = true;
+		printf("[%s]   source at %.1f fps, %llu of %llu captured frames changed\n", NAME,
+			(Stats::changes - Stats::changes_reported) * 1000.0 / std::max<Uint32>(1, now - Stats::reported),
+			static_cast<unsigned long long>(Stats::changes), static_cast<unsigned long long>(Stats::captures));
 
-		Audio::index = 0;
-		Audio::drops = 0;
+		Stats::changes_reported = Stats::changes;
+		Stats::reported = now;
 	}
 
-	static inline bool load(UCHAR *p_buf, ULONG *p_read) {
-		if (*p_read <= FRAME_SIZE_RGB) {
-			return false;
-		}
+private:
+	static constexpr uint64_t PERIOD = 1000000000 / FRAMERATE_LIMIT;
 
-		if (Audio::samples.size() > SAMPLE_LIMIT) {
-			if (++Audio::drops > DROP_LIMIT) {
-				Audio::reset();
-			}
+	static inline std::atomic<uint64_t> completed[BUF_COUNT];
+	static inline uint64_t completed_last = 0;
 
-			else {
-				return false;
-			}
-		}
+	// only ever touched by the render thread
+	static inline uint64_t presented_last = 0;
+	static inline uint64_t frames = 0;
+	static inline uint64_t duplicated = 0;
+	static inline uint64_t late = 0;
 
-		Audio::drops = 0;
+	static inline uint64_t captures = 0;
+	static inline uint64_t changes = 0;
+	static inline uint64_t changes_reported = 0;
 
-		Audio::map(p_buf, Audio::buf[Audio::index]);
-		Audio::samples.emplace(Audio::buf[Audio::index], (*p_read - FRAME_SIZE_RGB) / 2);
+	static inline Uint32 reported = 0;
 
-		return true;
+	static inline void print(const char *p_name, const Histogram &histogram) {
+		printf("[%s]   %-8s p50 %6.2f  p99 %6.2f  max %6.2f ms (%llu)\n", NAME, p_name,
+			histogram.percentile(0.50) / 1e6, histogram.percentile(0.99) / 1e6, histogram.max() / 1e6,
+			static_cast<unsigned long long>(histogram.count()));
 	}
+};
 
-	static inline void map(UCHAR *p_in, Sint16 *p_out) {
-		for (int i = 0; i < SAMPLE_SIZE_16; ++i) {
-			p_out[i] = p_in[i * 2 + 1] << 8 | p_in[i * 2];
-		}
-	}
+// a lossless codec for the raw frames, which mostly repeat the previous one and are full of flat areas. a row that didn't
+// change is a single mark, and any other is the difference to whichever predicts it best of the previous frame's row, its
+// own left neighbours or the row two above, the nearest one from the same screen. the differences are zigzagged so the
+// small ones either way are small values, and every block of 16 of them is stored as only as many bit planes as its
+// biggest value needs, so a row that barely changed packs into a few bytes
+class Codec {
+public:
+	enum Type { SAME, TEMPORAL, LEFT, UP };
 
-	static inline void unblock() {
-		if (Audio::blocked) {
-			Audio::blocked = false;
-			Audio::barrier.set_value();
-		}
+	// a frame is a flag byte, then a 2 bit type per row, then each row that changed as its blocks' widths as nibbles
+	// followed by their planes
+	static inline bool key(const UCHAR *p_in) {
+		return *p_in & 1;
 	}
 
-	~Audio() {
-		if (device_id != 0) {
-			SDL_CloseAudioDevice(device_id);
-		}
-	}
-};
-
-class Video {
-public:
-	class Screen {
-	public:
-		enum Type { TOP, BOT, JOINT, SIZE };
-		enum Crop { DEFAULT_3DS, SCALED_DS, NATIVE_DS, COUNT };
-		enum Fulltype { ONLY_TOP, ONLY_BOT, TOP_BOT_LT, TOP_BOT_RT, TOP_BOT_RB, TOP_BOT_LB, BOT_TOP_LT, BOT_TOP_RT, BOT_TOP_RB, BOT_TOP_LB, MODS };
-
-		static inline const int widths[Video::Screen::Crop::COUNT] = { 400, 320, 256 };
-		static inline const int heights[Video::Screen::Crop::COUNT] = { 240, 240, 192 };
-
-		SDL_Window *m_window;
-		SDL_Renderer *m_renderer;
-		SDL_Texture *m_in_texture;
-		SDL_Texture *m_out_texture;
-		SDL_Rect m_in_rect;
-		SDL_Rect m_out_rect;
-
-		Fulltype m_fulltype = Video::Screen::Fulltype::ONLY_TOP;
+	// a key frame only ever refers to itself, and is what any frame following a reset has to be
+	uint32_t encode(const UCHAR *p_in, UCHAR *p_out, bool key) {
+		key = key || !this->m_valid;
 
-		bool m_blur = false;
-		Crop m_crop = Video::Screen::Crop::DEFAULT_3DS;
-		int m_rotation = 0;
-		double m_scale = 1.0;
-		int zindex = 0;
-
-		Screen() : m_window(nullptr), m_renderer(nullptr), m_in_texture(nullptr), m_out_texture(nullptr) {}
-
-		std::string key() {
-			switch (this->m_type) {
-			case Video::Screen::Type::TOP:
-				return "top";
+		UCHAR *p_types = p_out + 1;
+		UCHAR *p_next = p_types + CODEC_TYPES;
 
-			case Video::Screen::Type::BOT:
-				return "bot";
+		*p_out = key;
+		memset(p_types, 0, CODEC_TYPES);
 
-			case Video::Screen::Type::JOINT:
-				return "joint";
+		for (int row = 0; row < CAP_HEIGHT; ++row) {
+			const UCHAR *p_row = &p_in[row * CODEC_ROW];
+			UCHAR *p_previous = &this->m_previous[row * CODEC_ROW];
 
-			default:
-				return "";
+			if (!key && !memcmp(p_row, p_previous, CODEC_ROW)) {
+				continue;
 			}
-		}
 
-		void build(Video::Screen::Type type, int u, int width, bool visible) {
-			this->m_type = type;
+			// the left neighbours of the first pixel are black
+			memcpy(&this->m_left[3], p_row, CODEC_ROW - 3);
 
-			this->resize(this->width(Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS]), this->height(Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS]));
+			int best = Codec::LEFT;
+			int cost = Codec::p_residual(p_row, this->m_left, this->m_z[Codec::LEFT], this->m_widths[Codec::LEFT]);
 
-			// Set up input rectangle (source texture coordinates)
-			this->m_in_rect.x = 0;
-			this->m_in_rect.y = u;
-			this->m_in_rect.w = this->m_height;
-			this->m_in_rect.h = width;
+			if (!key) {
+				int temporal = Codec::p_residual(p_row, p_previous, this->m_z[Codec::TEMPORAL], this->m_widths[Codec::TEMPORAL]);
 
-			// Set up output rectangle (destination on screen)
-			this->m_out_rect.x = (width - this->m_height) / 2;
-			this->m_out_rect.y = (this->m_height - width) / 2;
-			this->m_out_rect.w = this->m_height;
-			this->m_out_rect.h = width;
-			
-			if (visible) {
-				this->open();
+				if (temporal < cost) {
+					best = Codec::TEMPORAL;
+					cost = temporal;
+				}
 			}
-		}
 
-		void reset() {
-			if(g_kmsdrm){
-				if(this->m_type == Video::Screen::Type::TOP || this->m_type == Video::Screen::Type::JOINT){
-					this->resize(g_display_bounds[0].w, g_display_bounds[0].h);
-				}else{
-					this->resize(g_display_bounds[1].w, g_display_bounds[1].h);	
+			if (row >= 2 && cost) {
+				if (Codec::p_residual(p_row, p_row - CODEC_ROW * 2, this->m_z[Codec::UP], this->m_widths[Codec::UP]) < cost) {
+					best = Codec::UP;
 				}
-			}else{
-				this->resize(this->width(Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS]), this->height(Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS]));
 			}
 
-			if (this->m_in_texture) {
-				SDL_DestroyTexture(this->m_in_texture);
-			}
-			
-			if (this->m_renderer) {
-				this->m_in_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-														SDL_TEXTUREACCESS_STREAMING, CAP_WIDTH, CAP_HEIGHT);
-			}
+			p_types[row / 4] |= best << (row % 4 * 2);
 
-			if (this->m_out_texture) {
-				SDL_DestroyTexture(this->m_out_texture);
-			}
-			
-			if (this->m_renderer) {
-				this->m_out_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-														SDL_TEXTUREACCESS_TARGET, this->m_width, this->m_height);
+			for (int block = 0; block < CODEC_BLOCKS; block += 2) {
+				*p_next++ = this->m_widths[best][block] | (block + 1 < CODEC_BLOCKS ? this->m_widths[best][block + 1] << 4 : 0);
 			}
 
-			if (this->m_rotation) {
-				if (this->horizontal()) {
-					std::swap(this->m_width, this->m_height);
-				}
+			p_next += Codec::p_pack(this->m_z[best], this->m_widths[best], p_next);
 
-				this->rotate();
-			}
+			memcpy(p_previous, p_row, CODEC_ROW);
+		}
 
-			if (this->m_crop) {
-				this->crop();
-			}
+		this->m_valid = true;
 
-			this->move();
-		}
+		return p_next - p_out;
+	}
 
-		void blur() {
-			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, (this->m_blur)?"1":"0");
+	// rebuilds a frame onto the previous one decoded, and fails on a frame that doesn't follow one or is corrupt
+	bool decode(const UCHAR *p_in, uint32_t size, UCHAR *p_out) {
+		if (size < 1 + CODEC_TYPES || (!Codec::key(p_in) && !this->m_valid)) {
+			this->m_valid = false;
+			return false;
 		}
 
-		void move() {
-			// Reset position first
-			this->m_in_rect.x = 0;
-			this->m_in_rect.y = 0;
-
-			switch (this->m_type) {
-			case Video::Screen::Type::TOP:
-			{
-				int crop = Video::screens[Video::Screen::Type::JOINT].m_crop;
-				bool horizontal = Video::screens[Video::Screen::Type::JOINT].horizontal();
-				if (Video::split) {
-					crop = this->m_crop;
-					horizontal = this->horizontal();
-				} 
-
-				this->m_in_rect.y += ((Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS] - Video::Screen::widths[crop]) > 0 ? (Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS] - Video::Screen::widths[Video::Screen::Crop::SCALED_DS]) / 2:0) ;
-				int crop_width = Video::Screen::widths[Video::Screen::Crop::SCALED_DS];
-				if(this->m_in_rect.y == 0) {
-					crop_width = Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS];
-				}
+		bool key = Codec::key(p_in);
 
-				this->m_in_rect.h = crop_width;
+		const UCHAR *p_types = p_in + 1;
+		const UCHAR *p_next = p_types + CODEC_TYPES;
+		const UCHAR *p_end = p_in + size;
 
-				if(!g_kmsdrm) {
-					this->m_out_rect.w = Video::Screen::heights[crop];
-					this->m_out_rect.h = Video::Screen::widths[crop];
+		this->m_valid = false;
 
-					if (!horizontal) {
-						this->m_out_rect.x = (this->m_out_rect.h - this->m_out_rect.w) / 2;
-						this->m_out_rect.y = (this->m_out_rect.w - this->m_out_rect.h) / 2;
-					}
-					else {
-						this->m_out_rect.x = 0;
-						this->m_out_rect.y = 0;
-					}
-				}
-				else{
-					this->m_out_rect.x = (this->m_width - this->m_height) / 2;
-					this->m_out_rect.y = (this->m_height - this->m_width) / 2;
-					this->m_out_rect.w = this->m_height;
-					this->m_out_rect.h = this->m_width;
-				}
+		for (int row = 0; row < CAP_HEIGHT; ++row) {
+			int type = p_types[row / 4] >> (row % 4 * 2) & 3;
+			UCHAR *p_row = &this->m_previous[row * CODEC_ROW];
 
-				return;
+			if (type == Codec::SAME && !key) {
+				continue;
 			}
 
-			case Video::Screen::Type::BOT:
-			{
-				int crop = Video::screens[Video::Screen::Type::JOINT].m_crop;
-				bool horizontal = Video::screens[Video::Screen::Type::JOINT].horizontal();
-				if (Video::split) {
-					crop = this->m_crop;
-					horizontal = this->horizontal();
-				}
+			if (type == Codec::SAME || (type == Codec::TEMPORAL && key) || (type == Codec::UP && row < 2) || p_end - p_next < CODEC_WIDTHS) {
+				return false;
+			}
 
-				else {
-					this->m_in_rect.x += (Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS] - Video::Screen::heights[Video::Screen::Crop::SCALED_DS]) / 2;
-				}
+			UCHAR widths[CODEC_BLOCKS];
+			int bytes = 0;
 
-				this->m_in_rect.y += Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS];
-					
-				if(!g_kmsdrm) {
-					this->m_out_rect.w = Video::Screen::heights[crop];
-					this->m_out_rect.h = width(Video::Screen::widths[crop]);
+			for (int block = 0; block < CODEC_BLOCKS; ++block) {
+				widths[block] = p_next[block / 2] >> (block % 2 * 4) & 0xf;
+				bytes += widths[block] * 2;
 
-					if (!horizontal) {
-						this->m_out_rect.x = (this->m_out_rect.h - this->m_out_rect.w) / 2;
-						this->m_out_rect.y = (this->m_out_rect.w - this->m_out_rect.h) / 2;
-					}
-					else {
-						this->m_out_rect.x = 0;
-						this->m_out_rect.y = 0;
-					}	
-				}
-				else{
-					this->m_out_rect.x = (this->m_width - this->m_height) / 2;
-					this->m_out_rect.y = (this->m_height - this->m_width) / 2;
-					this->m_out_rect.w = this->m_height;
-					this->m_out_rect.h = this->m_width;
+				if (widths[block] > 8) {
+					return false;
 				}
+			}
 
-				return;
+			p_next += CODEC_WIDTHS;
+
+			if (p_end - p_next < bytes) {
+				return false;
 			}
 
-			case Video::Screen::Type::JOINT:
-			{
-				Video::screens[Video::Screen::Type::TOP].move();
-				Video::screens[Video::Screen::Type::BOT].move();
-
-				SDL_Rect *top_screen = &Video::screens[Video::Screen::Type::TOP].m_out_rect;
-				SDL_Rect *bottom_screen = &Video::screens[Video::Screen::Type::BOT].m_out_rect;
-
-				if (g_kmsdrm) {
-					top_screen->x = (this->m_width - this->m_height) / 2;
-					top_screen->y = (this->m_height - this->m_width) / 2;
-					top_screen->w = this->m_height;
-					top_screen->h = this->m_width;
-
-					bottom_screen->x = (this->m_width - this->m_height) / 2,
-					bottom_screen->y = (this->m_height - this->m_width) / 2,
-					bottom_screen->w = this->m_height;
-					bottom_screen->h = this->m_width;
-
-					switch(this->m_fulltype) {
-						case Video::Screen::Fulltype::ONLY_TOP:
-						{
-							bottom_screen->w = 0;
-							bottom_screen->h = 0;
-							break;
-						}
-						case Video::Screen::Fulltype::ONLY_BOT:
-						{
-							top_screen->w = 0;
-							top_screen->h = 0;
-							break;
-						}
-						case Video::Screen::Fulltype::MODS:
-							// This shouldn't happen in normal operation
-							break;
-						default: {
-							auto setRect = [](SDL_Rect* rect, int x, int y, int w, int h) {
-								rect->x = x;
-								rect->y = y;
-								rect->w = w;
-								rect->h = h;
-							};
-
-							struct Layout {
-								bool bot_on_top;
-								int z_bot, z_top;
-								int x_off, y_off;
-							};
-
-							static const std::map<Video::Screen::Fulltype, Layout> layouts = {
-								{ Video::Screen::Fulltype::TOP_BOT_LT, {true, 1, 0, (this->m_width/4 - this->m_height/4) / 2, (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::TOP_BOT_RT, {true, 1, 0, this->m_width - this->m_height/4 - (this->m_width/4 - this->m_height/4) / 2, (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::TOP_BOT_LB, {true, 1, 0, (this->m_width/4 - this->m_height/4) / 2, this->m_height - this->m_width/4 - (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::TOP_BOT_RB, {true, 1, 0, this->m_width - this->m_height/4 - (this->m_width/4 - this->m_height/4) / 2, this->m_height - this->m_width/4 - (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::BOT_TOP_LT, {false, 0, 1, (this->m_width/4 - this->m_height/4) / 2, (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::BOT_TOP_RT, {false, 0, 1, this->m_width - this->m_height/4 - (this->m_width/4 - this->m_height/4) / 2, (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::BOT_TOP_LB, {false, 0, 1, (this->m_width/4 - this->m_height/4) / 2, this->m_height - this->m_width/4 - (this->m_height/4 - this->m_width/4) / 2} },
-								{ Video::Screen::Fulltype::BOT_TOP_RB, {false, 0, 1, this->m_width - this->m_height/4 - (this->m_width/4 - this->m_height/4) / 2, this->m_height - this->m_width/4 - (this->m_height/4 - this->m_width/4) / 2} },
-							};
-
-							auto it = layouts.find(this->m_fulltype);
-							if (it != layouts.end()) {
-								const auto& l = it->second;
-								Video::screens[Video::Screen::Type::BOT].zindex = l.z_bot;
-								Video::screens[Video::Screen::Type::TOP].zindex = l.z_top;
-								if (l.bot_on_top) {
-									setRect(bottom_screen, l.x_off, l.y_off, this->m_height/4, this->m_width/4);
-								} else {
-									setRect(top_screen, l.x_off, l.y_off, this->m_height/4, this->m_width/4);
-								}
-							}
-							break;
-						}
-					}
-				}
-				else {
-					switch(this->m_rotation) {
-						case 0:
-						{
-							int bot_diff = (bottom_screen->h - bottom_screen->w) / 2;
-							bottom_screen->x = (top_screen->h - bottom_screen->h) / 2 + bot_diff;
-							bottom_screen->y += top_screen->w;
-							break;
-						}
-						case 90:
-						{
-							bottom_screen->y = (top_screen->h - bottom_screen->h) / 2;
-							top_screen->x += bottom_screen->w;
-							break;
-						}
-						case 180:
-						{
-							int bot_diff = (bottom_screen->h - bottom_screen->w) / 2;
-							bottom_screen->x = (top_screen->h - bottom_screen->h) / 2 + bot_diff;
-							top_screen->y += bottom_screen->w;
-							break;
-						}
-						case 270:
-						{
-							bottom_screen->y = (top_screen->h - bottom_screen->h) / 2;
-							bottom_screen->x += top_screen->w;
-							break;
-						}
-					}
-				}
+			Codec::p_unpack(p_next, widths, this->m_z[0]);
+			p_next += bytes;
+
+			if (type == Codec::LEFT) {
+				Codec::left(this->m_z[0], p_row);
 			}
 
-			case Video::Screen::Type::SIZE:
-				// This shouldn't happen in normal operation
-				return;
+			else {
+				Codec::p_restore(this->m_z[0], type == Codec::UP ? p_row - CODEC_ROW * 2 : p_row, p_row);
 			}
 		}
 
-		void toggle() {
-			this->m_window ? this->close() : this->open();
-		}
+		this->m_valid = true;
 
-		void close() {
-			if (this->m_in_texture) {
-				SDL_DestroyTexture(this->m_in_texture);
-				this->m_in_texture = nullptr;
-			}
-			if (this->m_out_texture) {
-				SDL_DestroyTexture(this->m_out_texture);
-				this->m_out_texture = nullptr;
-			}
-			if (this->m_renderer) {
-				SDL_DestroyRenderer(this->m_renderer);
-				this->m_renderer = nullptr;
-			}
-			if (this->m_window) {
-				SDL_DestroyWindow(this->m_window);
-				this->m_window = nullptr;
-			}
+		if (p_out) {
+			memcpy(p_out, this->m_previous, FRAME_SIZE_RGB);
 		}
 
-		void draw() {
-			if (!this->m_window || !this->m_renderer) return;
-			if (!g_kmsdrm) {
-				SDL_SetWindowSize(this->m_window, this->m_width * this->m_scale, this->m_height * this->m_scale);
-			}
-			
-			// Set render target to output texture
-			SDL_SetRenderTarget(this->m_renderer, this->m_out_texture);
-			SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
-			SDL_RenderClear(this->m_renderer);
+		return true;
+	}
 
-			// Copy input texture to output texture with rotation
-			if (this->m_in_texture) {
-				SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, &this->m_in_rect, &this->m_out_rect, 
-								this->m_rotation - 90, NULL, SDL_FLIP_NONE);
-			}
+	void reset() {
+		this->m_valid = false;
+	}
 
-			// Reset render target to window
-			SDL_SetRenderTarget(this->m_renderer, nullptr);
-			SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
-			SDL_RenderClear(this->m_renderer);
+	static inline void dispatch() {
+		const char *kernel = "scalar";
 
-			// Apply brightness by modulating texture color
-			Uint8 brightness = static_cast<Uint8>(Video::brightness * 2.55f);
-			SDL_SetTextureColorMod(this->m_out_texture, brightness, brightness, brightness);
+#ifdef SIMD_X86
+		if (SDL_HasSSE2()) {
+			Codec::p_residual = Codec::residual_sse2;
+			Codec::p_pack = Codec::pack_sse2;
+			Codec::p_unpack = Codec::unpack_sse2;
+			Codec::p_restore = Codec::restore_sse2;
+			kernel = "sse2";
+		}
+#endif
 
-			// Render output texture to window with rotation
-			SDL_RenderCopy(this->m_renderer, this->m_out_texture, nullptr, nullptr);
-			SDL_RenderPresent(this->m_renderer);
+#ifdef SIMD_NEON
+		if (SDL_HasNEON()) {
+			Codec::p_residual = Codec::residual_neon;
+			Codec::p_pack = Codec::pack_neon;
+			Codec::p_unpack = Codec::unpack_neon;
+			Codec::p_restore = Codec::restore_neon;
+			kernel = "neon";
 		}
+#endif
 
-		void draw(SDL_Rect *p_top_rect, SDL_Rect *p_top_out_rect, SDL_Rect *p_bot_rect, SDL_Rect *p_bot_out_rect) {
-			if (!this->m_window || !this->m_renderer) return;
-			if (!g_kmsdrm) {
-				SDL_SetWindowSize(this->m_window, this->m_width * this->m_scale, this->m_height * this->m_scale);
-			}
+		printf("[%s] Using %s frame codec.\n", NAME, kernel);
+	}
 
-			// Set render target to output texture
-			SDL_SetRenderTarget(this->m_renderer, this->m_out_texture);
-			SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
-			SDL_RenderClear(this->m_renderer);
+private:
+	friend class Bench;
 
-			// Copy both screen textures to output texture with rotation
-			if (this->m_in_texture) {
-				if(Video::screens[Video::Screen::Type::BOT].zindex > Video::screens[Video::Screen::Type::TOP].zindex) {
-					SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, p_top_rect, p_top_out_rect, 
-						this->m_rotation - 90, NULL, SDL_FLIP_NONE);
-					SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, p_bot_rect, p_bot_out_rect, 
-						this->m_rotation - 90, NULL, SDL_FLIP_NONE);
-				}else{
-					SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, p_bot_rect, p_bot_out_rect, 
-						this->m_rotation - 90, NULL, SDL_FLIP_NONE);
-					SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, p_top_rect, p_top_out_rect, 
-						this->m_rotation - 90, NULL, SDL_FLIP_NONE);
-				}
-				
-			}
+	UCHAR m_previous[FRAME_SIZE_RGB];
+	bool m_valid = false;
 
-			// Reset render target to window
-			SDL_SetRenderTarget(this->m_renderer, nullptr);
-			SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
-			SDL_RenderClear(this->m_renderer);
+	UCHAR m_left[CODEC_ROW] = {};
+	UCHAR m_z[4][CODEC_ROW];
+	UCHAR m_widths[4][CODEC_BLOCKS];
 
-			// Apply brightness by modulating texture color
-			Uint8 brightness = static_cast<Uint8>(Video::brightness * 2.55f);
-			SDL_SetTextureColorMod(this->m_out_texture, brightness, brightness, brightness);
+	static inline int width(int value) {
+		return value ? 32 - __builtin_clz(value) : 0;
+	}
 
-			// Render output texture to window with rotation
-			SDL_RenderCopy(this->m_renderer, this->m_out_texture, nullptr, nullptr);
-			
-			SDL_RenderPresent(this->m_renderer);
-		}
+	// scalar fallbacks and the references the simd kernels have to match bit for bit, the cost being the bits per value
+	// summed over the blocks
+	static inline int residual(const UCHAR *p_row, const UCHAR *p_ref, UCHAR *p_z, UCHAR *p_widths) {
+		int cost = 0;
 
-		int m_width = 0;
-		int m_height = 0;
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			UCHAR bits = 0;
 
-		void rotateLeft() {
-			if (g_kmsdrm) {
-				return;
+			for (int i = block * 16; i < block * 16 + 16; ++i) {
+				UCHAR difference = p_row[i] - p_ref[i];
+
+				p_z[i] = difference << 1 ^ (difference & 0x80 ? 0xff : 0);
+				bits |= p_z[i];
 			}
 
-			this->m_rotation = ((this->m_rotation / 90 * 90 - 90) % 360 + 360) % 360;
-			this->rotate();
+			p_widths[block] = Codec::width(bits);
+			cost += p_widths[block];
 		}
 
-		void rotateRight() {
-			if (g_kmsdrm) {
-				return;
-			}
+		return cost;
+	}
 
-			this->m_rotation = ((this->m_rotation / 90 * 90 - 90) % 360 + 360) % 360;
-			this->rotate();
-		}
+	// bit b of every value in a block goes into plane b, two bytes holding the bit of the first 8 values and then the last 8
+	static inline int pack(const UCHAR *p_z, const UCHAR *p_widths, UCHAR *p_out) {
+		UCHAR *p_start = p_out;
 
-		void rotate() {
-			if (this->m_window) {
-				SDL_SetWindowSize(this->m_window, this->m_width * this->m_scale, this->m_height * this->m_scale);
-			}
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			for (int bit = 0; bit < p_widths[block]; ++bit) {
+				int plane = 0;
 
-			if (this->m_out_texture) {
-				SDL_DestroyTexture(this->m_out_texture);
-			}
-			
-			if (this->m_renderer) {
-				this->m_out_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-														SDL_TEXTUREACCESS_TARGET, this->m_width, this->m_height);
+				for (int i = 0; i < 16; ++i) {
+					plane |= (p_z[block * 16 + i] >> bit & 1) << i;
+				}
+
+				*p_out++ = plane;
+				*p_out++ = plane >> 8;
 			}
 		}
 
-		void crop() {
-			if (g_kmsdrm) {
-				return;
-			}
+		return p_out - p_start;
+	}
 
-			this->horizontal() ? this->resize(this->height(Video::Screen::heights[this->m_crop]), this->width(Video::Screen::widths[this->m_crop])) : this->resize(this->width(Video::Screen::widths[this->m_crop]), this->height(Video::Screen::heights[this->m_crop]));
+	static inline void unpack(const UCHAR *p_in, const UCHAR *p_widths, UCHAR *p_z) {
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			memset(&p_z[block * 16], 0, 16);
 
-			if (this->m_window) {
-				SDL_SetWindowSize(this->m_window, this->m_width * this->m_scale, this->m_height * this->m_scale);
-			}
+			for (int bit = 0; bit < p_widths[block]; ++bit, p_in += 2) {
+				int plane = p_in[0] | p_in[1] << 8;
 
-			if (this->m_out_texture) {
-				SDL_DestroyTexture(this->m_out_texture);
-			}
-			
-			if (this->m_renderer) {
-				this->m_out_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-														SDL_TEXTUREACCESS_TARGET, this->m_width, this->m_height);
+				for (int i = 0; i < 16; ++i) {
+					p_z[block * 16 + i] |= (plane >> i & 1) << bit;
+				}
 			}
 		}
+	}
 
-	private:
-		Screen::Type m_type;
-
-		bool horizontal() {
-			return this->m_rotation / 10 % 2;
+	static inline void restore(const UCHAR *p_z, const UCHAR *p_ref, UCHAR *p_out) {
+		for (int i = 0; i < CODEC_ROW; ++i) {
+			p_out[i] = p_ref[i] + ((p_z[i] >> 1) ^ (p_z[i] & 1 ? 0xff : 0));
 		}
+	}
 
-		int height(int height) {
-			return height * (this->m_type == Video::Screen::Type::JOINT ? 2 : 1);
+	// every pixel depends on the one just rebuilt, so this one stays scalar
+	static inline void left(const UCHAR *p_z, UCHAR *p_out) {
+		for (int i = 0; i < CODEC_ROW; ++i) {
+			p_out[i] = (i >= 3 ? p_out[i - 3] : 0) + ((p_z[i] >> 1) ^ (p_z[i] & 1 ? 0xff : 0));
 		}
+	}
 
-		int width(int width) {
-			return (this->m_type == Video::Screen::Type::BOT && width == this->widths[Video::Screen::Crop::DEFAULT_3DS]) ? this->widths[Video::Screen::Crop::SCALED_DS] : width;
-		}
+#ifdef SIMD_X86
+	SIMD_TARGET("sse2") static inline int residual_sse2(const UCHAR *p_row, const UCHAR *p_ref, UCHAR *p_z, UCHAR *p_widths) {
+		const __m128i zero = _mm_setzero_si128();
 
-		std::string title() {
-			switch (this->m_type) {
-			case Video::Screen::Type::TOP:
-				return std::string(NAME) + "-top";
+		int cost = 0;
 
-			case Video::Screen::Type::BOT:
-				return std::string(NAME) + "-bot";
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			__m128i difference = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_row[block * 16])), _mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_ref[block * 16])));
+			__m128i z = _mm_xor_si128(_mm_add_epi8(difference, difference), _mm_cmpgt_epi8(zero, difference));
 
-			default:
-				return NAME;
-			}
-		}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&p_z[block * 16]), z);
 
-		void resize(int width, int height) {
-			this->m_width = width;
-			this->m_height = height;
+			__m128i bits = _mm_or_si128(z, _mm_srli_si128(z, 8));
+			bits = _mm_or_si128(bits, _mm_srli_si128(bits, 4));
+			bits = _mm_or_si128(bits, _mm_srli_si128(bits, 2));
+			bits = _mm_or_si128(bits, _mm_srli_si128(bits, 1));
+
+			p_widths[block] = Codec::width(_mm_cvtsi128_si32(bits) & 0xff);
+			cost += p_widths[block];
 		}
 
-		void open() {
-			this->blur();
-			if(g_kmsdrm){
-				int numScreen = (this->m_type == Video::Screen::Type::JOINT)?0:this->m_type;
+		return cost;
+	}
 
-				this->m_window = SDL_CreateWindow(this->title().c_str(), 
-											g_display_bounds[numScreen].x, g_display_bounds[numScreen].y, 
-											g_display_bounds[numScreen].w, g_display_bounds[numScreen].h, 
-											SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-			}else{
-				this->m_window = SDL_CreateWindow(this->title().c_str(), 
-											SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
-											this->m_width * this->m_scale, this->m_height * this->m_scale, 
-											SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-			}
+	// shifting bit b of every byte up to its top bit lets movemask gather a whole plane at once
+	SIMD_TARGET("sse2") static inline int pack_sse2(const UCHAR *p_z, const UCHAR *p_widths, UCHAR *p_out) {
+		UCHAR *p_start = p_out;
 
-			if (!this->m_window) {
-				printf("[%s] SDL_CreateWindow failed: %s\n", NAME, SDL_GetError());
-				return;
-			}
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			__m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_z[block * 16]));
 
-			this->m_renderer = SDL_CreateRenderer(this->m_window, -1, 
-				Video::vsync ? SDL_RENDERER_PRESENTVSYNC : SDL_RENDERER_ACCELERATED);
+			for (int bit = 0; bit < p_widths[block]; ++bit) {
+				int plane = _mm_movemask_epi8(_mm_sll_epi64(z, _mm_cvtsi32_si128(7 - bit)));
 
-			if (!this->m_renderer) {
-				printf("[%s] SDL_CreateRenderer failed: %s\n", NAME, SDL_GetError());
-				SDL_DestroyWindow(this->m_window);
-				this->m_window = nullptr;
-				return;
+				*p_out++ = plane;
+				*p_out++ = plane >> 8;
 			}
+		}
 
-			// Create input texture for capture data
-			this->m_in_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-													SDL_TEXTUREACCESS_STREAMING, CAP_WIDTH, CAP_HEIGHT);
-			if (!this->m_in_texture) {
-				printf("[%s] SDL_CreateTexture (input) failed: %s\n", NAME, SDL_GetError());
-			}
+		return p_out - p_start;
+	}
 
-			// Create output texture
-			this->m_out_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
-													SDL_TEXTUREACCESS_TARGET, this->m_width, this->m_height);
-			if (!this->m_out_texture) {
-				printf("[%s] SDL_CreateTexture (output) failed: %s\n", NAME, SDL_GetError());
+	// each plane byte is spread over the 8 values it covers, and every value tests its own bit of it
+	SIMD_TARGET("sse2") static inline void unpack_sse2(const UCHAR *p_in, const UCHAR *p_widths, UCHAR *p_z) {
+		const __m128i select = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			__m128i z = _mm_setzero_si128();
+
+			for (int bit = 0; bit < p_widths[block]; ++bit, p_in += 2) {
+				__m128i plane = _mm_cvtsi32_si128(p_in[0] | p_in[1] << 8);
+				plane = _mm_unpacklo_epi8(plane, plane);
+				plane = _mm_unpacklo_epi16(plane, plane);
+				plane = _mm_unpacklo_epi32(plane, plane);
+
+				__m128i set = _mm_cmpeq_epi8(_mm_and_si128(plane, select), select);
+				z = _mm_or_si128(z, _mm_and_si128(set, _mm_set1_epi8(1 << bit)));
 			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&p_z[block * 16]), z);
 		}
+	}
 
+	SIMD_TARGET("sse2") static inline void restore_sse2(const UCHAR *p_z, const UCHAR *p_ref, UCHAR *p_out) {
+		const __m128i one = _mm_set1_epi8(1);
+		const __m128i low = _mm_set1_epi8(0x7f);
 
-	};
+		for (int i = 0; i < CODEC_ROW; i += 16) {
+			__m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_z[i]));
+			__m128i difference = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(z, 1), low), _mm_cmpeq_epi8(_mm_and_si128(z, one), one));
 
-	static inline Screen screens[Video::Screen::Type::SIZE];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&p_out[i]), _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_ref[i])), difference));
+		}
+	}
+#endif
 
-	static inline int brightness = 100;
+#ifdef SIMD_NEON
+	static inline int residual_neon(const UCHAR *p_row, const UCHAR *p_ref, UCHAR *p_z, UCHAR *p_widths) {
+		int cost = 0;
 
-	static inline bool split = false;
-	static inline bool vsync = false;
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			uint8x16_t difference = vsubq_u8(vld1q_u8(&p_row[block * 16]), vld1q_u8(&p_ref[block * 16]));
+			uint8x16_t z = veorq_u8(vshlq_n_u8(difference, 1), vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(difference), 7)));
 
-	static inline std::promise<int> promise;
-	static inline bool waiting = false;
+			vst1q_u8(&p_z[block * 16], z);
 
-	static inline void (*p_load) (std::string path, std::string name);
-	static inline void (*p_save) (std::string path, std::string name);
+			uint8x8_t bits = vorr_u8(vget_low_u8(z), vget_high_u8(z));
+			bits = vpmax_u8(bits, bits);
+			bits = vpmax_u8(bits, bits);
+			bits = vpmax_u8(bits, bits);
 
-	static inline Screen *screen(std::string key) {
-		if (key == "top") {
-			return &Video::screens[Video::Screen::Type::TOP];
+			p_widths[block] = Codec::width(vget_lane_u8(bits, 0));
+			cost += p_widths[block];
 		}
 
-		if (key == "bot") {
-			return &Video::screens[Video::Screen::Type::BOT];
-		}
+		return cost;
+	}
 
-		if (key == "joint") {
-			return &Video::screens[Video::Screen::Type::JOINT];
+	// the values with bit b set keep their own place value, which pairwise adds then gather into the plane's two bytes
+	static inline int pack_neon(const UCHAR *p_z, const UCHAR *p_widths, UCHAR *p_out) {
+		static const UCHAR places[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+		const uint8x16_t place = vld1q_u8(places);
+
+		UCHAR *p_start = p_out;
+
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			uint8x16_t z = vld1q_u8(&p_z[block * 16]);
+
+			for (int bit = 0; bit < p_widths[block]; ++bit) {
+				uint8x16_t set = vandq_u8(vtstq_u8(z, vdupq_n_u8(1 << bit)), place);
+
+				uint8x8_t plane = vpadd_u8(vget_low_u8(set), vget_high_u8(set));
+				plane = vpadd_u8(plane, plane);
+				plane = vpadd_u8(plane, plane);
+
+				*p_out++ = vget_lane_u8(plane, 0);
+				*p_out++ = vget_lane_u8(plane, 1);
+			}
 		}
 
-		return nullptr;
+		return p_out - p_start;
 	}
 
-	static inline void init() {
-		Video::screens[Video::Screen::Type::TOP].reset();
-		Video::screens[Video::Screen::Type::BOT].reset();
-		Video::screens[Video::Screen::Type::JOINT].reset();
+	static inline void unpack_neon(const UCHAR *p_in, const UCHAR *p_widths, UCHAR *p_z) {
+		static const UCHAR places[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
 
-		if (!((Video::screens[Video::Screen::Type::JOINT].m_window != nullptr) ^ Video::split)) {
-			Video::screens[Video::Screen::Type::TOP].toggle();
-			Video::screens[Video::Screen::Type::BOT].toggle();
-			Video::screens[Video::Screen::Type::JOINT].toggle();
-		}
+		const uint8x16_t place = vld1q_u8(places);
 
-		if (Video::split) {
-			Video::screens[Video::Screen::Type::TOP].move();
-			Video::screens[Video::Screen::Type::BOT].move();
+		for (int block = 0; block < CODEC_BLOCKS; ++block) {
+			uint8x16_t z = vdupq_n_u8(0);
+
+			for (int bit = 0; bit < p_widths[block]; ++bit, p_in += 2) {
+				uint8x16_t plane = vcombine_u8(vdup_n_u8(p_in[0]), vdup_n_u8(p_in[1]));
+
+				z = vorrq_u8(z, vandq_u8(vtstq_u8(plane, place), vdupq_n_u8(1 << bit)));
+			}
+
+			vst1q_u8(&p_z[block * 16], z);
 		}
-		else {
-			Video::screens[Video::Screen::Type::JOINT].move();
+	}
+
+	static inline void restore_neon(const UCHAR *p_z, const UCHAR *p_ref, UCHAR *p_out) {
+		const uint8x16_t one = vdupq_n_u8(1);
+
+		for (int i = 0; i < CODEC_ROW; i += 16) {
+			uint8x16_t z = vld1q_u8(&p_z[i]);
+			uint8x16_t difference = veorq_u8(vshrq_n_u8(z, 1), vtstq_u8(z, one));
+
+			vst1q_u8(&p_out[i], vaddq_u8(vld1q_u8(&p_ref[i]), difference));
 		}
 	}
+#endif
 
-	static inline void blank() {
-		memset(Video::buf, 0x00, FRAME_SIZE_RGBA);
+	static inline int (*p_residual) (const UCHAR *p_row, const UCHAR *p_ref, UCHAR *p_z, UCHAR *p_widths) = Codec::residual;
+	static inline int (*p_pack) (const UCHAR *p_z, const UCHAR *p_widths, UCHAR *p_out) = Codec::pack;
+	static inline void (*p_unpack) (const UCHAR *p_in, const UCHAR *p_widths, UCHAR *p_z) = Codec::unpack;
+	static inline void (*p_restore) (const UCHAR *p_z, const UCHAR *p_ref, UCHAR *p_out) = Codec::restore;
+};
 
-		unsigned char* image = nullptr;
-		unsigned width, height;
+// tees completed transfers into a recording made of a magic followed by one record per transfer, each being a little endian
+// header (nanoseconds since the first transfer, the transfer's real read length, and the packed length or zero) and either
+// read bytes of payload or, when recording with the codec, the packed frame followed by the transfer's samples.
+// a finished recording ends with an index of every record, padded to 8 bytes and followed by a footer pointing back at it,
+// which a recording cut short simply lacks.
+// the capture thread only ever copies a transfer into a free slot, a writer thread of its own draining the slots to disk,
+// and a transfer finding no free slot is counted and dropped rather than waited for
+class Recorder {
+public:
+	struct Record {
+		uint64_t time;
+		uint32_t read;
+		uint32_t packed;
+	};
 
-		unsigned error = lodepng_decode32_file(&image, &width, &height, (getExecutionPath() + "blank.png").c_str());
-		if (error) {
-			printf("Error %u: %s\n", error, lodepng_error_text(error));
-		}else{
-			memcpy(Video::buf, image, FRAME_SIZE_RGBA);
-			free(image);
+	// where a record starts in the file, along with its header's time and lengths
+	struct Entry {
+		uint64_t offset;
+		uint64_t time;
+		uint32_t read;
+		uint32_t packed;
+	};
+
+	struct Footer {
+		uint64_t index;
+		uint64_t count;
+		char magic[8];
+	};
+
+	static inline const char magic[8] = { 'X', 'X', '3', 'D', 'S', 'R', 'A', 'W' };
+	static inline const char index_magic[8] = { 'X', 'X', '3', 'D', 'S', 'I', 'D', 'X' };
+
+	static inline bool compress = false;
+
+	static inline bool recording() {
+		return Recorder::active.load();
+	}
+
+	static inline bool start(std::string path) {
+		if (Recorder::recording()) {
+			return false;
 		}
-		
-		// Update all screen textures
-		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
-			if (Video::screens[i].m_in_texture) {
-				SDL_UpdateTexture(Video::screens[i].m_in_texture, nullptr, Video::buf, CAP_WIDTH * 4);
-			}
+
+		// the file's own buffer turns the records into a few large sequential writes
+		Recorder::file.rdbuf()->pubsetbuf(Recorder::stream, sizeof(Recorder::stream));
+		Recorder::file.open(path, std::ios::binary | std::ios::trunc);
+
+		if (!Recorder::file.good()) {
+			printf("[%s] Recording \"%s\" open failed.\n", NAME, path.c_str());
+			Recorder::file.close();
+			return false;
 		}
 
-		Video::draw();
-	}
+		Recorder::file.write(Recorder::magic, sizeof(Recorder::magic));
 
-	static inline void render() {
-		while (g_running) {
-			Video::poll();
+		Recorder::path = path;
+		Recorder::first = true;
+		Recorder::offset = sizeof(Recorder::magic);
+		Recorder::entries.clear();
+		Recorder::written = 0;
+		Recorder::overflows = 0;
+		Recorder::failed = false;
+		Recorder::stopping = false;
 
-			if (!Capture::connected) {
-				Video::blank();
-				SDL_Delay(5);
+		Recorder::codec.reset();
+		Recorder::since = CODEC_KEY;
 
-				continue;
-			}
+		Recorder::active.store(true);
+		Recorder::writer = std::thread(Recorder::drain);
 
-			Video::promise = std::promise<int>();
-			Video::waiting = true;
+		printf("[%s] Recording to \"%s\".\n", NAME, path.c_str());
 
-			int ready = Video::promise.get_future().get();
+		return true;
+	}
 
-			if (ready == TRANSFER_ABORT) {
-				continue;
-			}
+	// whatever the writer hasn't written yet still makes it to the file
+	static inline void stop() {
+		if (!Recorder::recording()) {
+			return;
+		}
 
-			if (Capture::starting) {
-				Video::blank();
-				continue;
-			}
-			
-			if (!Video::load(Capture::buf[ready], &Capture::read[ready])) {
-				continue;
-			}
+		Recorder::active.store(false);
 
-			Video::draw();
+		while (Recorder::busy.load()) {
+			std::this_thread::yield();
 		}
-	}
 
+		Recorder::stopping = true;
+		SDL_SemPost(Recorder::semaphore);
+		Recorder::writer.join();
 
+		if (!Recorder::failed) {
+			Recorder::finish();
+		}
 
-private:
-	static inline UCHAR buf[FRAME_SIZE_RGBA];
+		Recorder::file.close();
 
-	static inline void toggleSplit() {
-		if (g_kmsdrm) {
+		printf("[%s] Recording \"%s\" wrote %llu and dropped %llu transfers.\n", NAME, Recorder::path.c_str(),
+			static_cast<unsigned long long>(Recorder::written), static_cast<unsigned long long>(Recorder::overflows.load()));
+	}
+
+	// a new recording every time one is started with the hotkey, named after when it was
+	static inline void toggle() {
+		if (Recorder::recording()) {
+			Recorder::stop();
 			return;
-		} 
+		}
 
-		Video::split ^= true;
-		Video::swap();
+		std::string path = CONF_DIR + "recordings/";
+		std::error_code error;
+		std::filesystem::create_directories(path, error);
+
+		char name[64];
+		time_t now = time(nullptr);
+		strftime(name, sizeof(name), "%Y%m%d-%H%M%S.raw", localtime(&now));
+
+		Recorder::start(path + NAME + "-" + name);
 	}
 
-	static inline void swap() {
-		Video::screens[Video::Screen::Type::TOP].toggle();
-		Video::screens[Video::Screen::Type::BOT].toggle();
-		Video::screens[Video::Screen::Type::JOINT].toggle();
+	// called by the capture thread on every completed transfer, before it is published and can be handed back to the device
+	static inline void tee(const UCHAR *p_buf, ULONG length) {
+		Recorder::busy.store(true);
 
-		if (Video::split) {
-			Video::screens[Video::Screen::Type::TOP].move();
-			Video::screens[Video::Screen::Type::BOT].move();
+		if (!Recorder::active.load()) {
+			Recorder::busy.store(false);
+			return;
 		}
-		else {
-			Video::screens[Video::Screen::Type::JOINT].move();
+
+		uint64_t head = Recorder::head.load(std::memory_order_relaxed);
+
+		if (head - Recorder::tail.load(std::memory_order_acquire) == RECORD_SLOTS) {
+			Recorder::overflows.fetch_add(1, std::memory_order_relaxed);
+			Recorder::busy.store(false);
+			return;
 		}
+
+		uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		if (Recorder::first) {
+			Recorder::first = false;
+			Recorder::start_time = now;
+		}
+
+		int slot = head % RECORD_SLOTS;
+		uint32_t read = std::min<ULONG>(length, BUF_SIZE);
+
+		Recorder::records[slot] = { now - Recorder::start_time, read, 0 };
+		memcpy(Recorder::buf[slot], p_buf, read);
+
+		Recorder::head.store(head + 1, std::memory_order_release);
+		Recorder::busy.store(false);
+
+		SDL_SemPost(Recorder::semaphore);
 	}
 
-	static inline void poll() {
-		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
-			switch (event.type) {
-			case SDL_QUIT:
-				g_running = false;
-				break;
+private:
+	static inline UCHAR buf[RECORD_SLOTS][BUF_SIZE];
+	static inline Record records[RECORD_SLOTS];
 
-			case SDL_WINDOWEVENT:
-				if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
-					g_running = false;
+	alignas(CACHE_LINE) static inline std::atomic<uint64_t> head{0};
+	alignas(CACHE_LINE) static inline std::atomic<uint64_t> tail{0};
+
+	static inline std::atomic<bool> active{false};
+	static inline std::atomic<bool> busy{false};
+	static inline std::atomic<uint64_t> overflows{0};
+
+	static inline SDL_sem *semaphore = SDL_CreateSemaphore(0);
+
+	static inline std::thread writer;
+	static inline std::ofstream file;
+	static inline std::string path;
+
+	static inline char stream[RECORD_BUFFER];
+
+	static inline bool first = true;
+	static inline uint64_t start_time = 0;
+
+	// the writer's position in the file and the records it has written so far, which become the index
+	static inline uint64_t offset = 0;
+	static inline std::vector<Entry> entries;
+
+	static inline uint64_t written = 0;
+	static inline bool failed = false;
+	static inline std::atomic<bool> stopping{false};
+
+	static inline Codec codec;
+	static inline UCHAR packed[CODEC_BOUND + SAMPLE_SIZE_8];
+	static inline int since = CODEC_KEY;
+
+	static inline void drain() {
+		while (true) {
+			uint64_t tail = Recorder::tail.load(std::memory_order_relaxed);
+			uint64_t head = Recorder::head.load(std::memory_order_acquire);
+
+			if (tail == head) {
+				if (Recorder::stopping) {
+					break;
 				}
-				break;
 
-			case SDL_KEYDOWN:
-				handleKeyDown(event);
-				break;
+				SDL_SemWaitTimeout(Recorder::semaphore, 100);
+				continue;
+			}
 
-			case SDL_KEYUP:
-				handleKeyUp(event);
-				break;
+			int slot = tail % RECORD_SLOTS;
+
+			// a full disk still drains the slots so capture carries on, it just stops being written
+			if (!Recorder::failed) {
+				Record &record = Recorder::records[slot];
+				const UCHAR *p_payload = Recorder::pack(record, Recorder::buf[slot]);
+				uint32_t length = record.packed ? record.packed : record.read;
+
+				Recorder::file.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+				Recorder::file.write(reinterpret_cast<const char*>(p_payload), length);
+
+				if (!Recorder::file.good()) {
+					printf("[%s] Recording \"%s\" write failed.\n", NAME, Recorder::path.c_str());
+					Recorder::failed = true;
+				}
+
+				else {
+					Recorder::entries.push_back({ Recorder::offset, record.time, record.read, record.packed });
+					Recorder::offset += sizeof(Record) + length;
+					++Recorder::written;
+				}
 			}
+
+			Recorder::tail.store(tail + 1, std::memory_order_release);
 		}
+
+		Recorder::file.flush();
 	}
 
-	static inline void handleKeyDown(const SDL_Event& event) {
-		// Get the focused window
-		Screen* focusedScreen = getFocusedScreen();
-		
-		switch (event.key.keysym.sym) {
-		// Global controls (affect all windows)
-		case SDLK_MINUS:
-			Video::brightness = Video::brightness > 5 ? Video::brightness / 5 * 5 - 5 : 0;
-			break;
+	// a transfer is only packed when it holds a whole frame and comes out smaller, and one that doesn't makes the next
+	// one a key frame, the frame it didn't pack not being there to refer to
+	static inline const UCHAR *pack(Record &record, const UCHAR *p_buf) {
+		if (!Recorder::compress || record.read < FRAME_SIZE_RGB) {
+			return p_buf;
+		}
 
-		case SDLK_EQUALS:
-		case SDLK_PLUS:
-			Video::brightness = Video::brightness < 95 ? Video::brightness / 5 * 5 + 5 : 100;
-			break;
+		uint32_t samples = record.read - FRAME_SIZE_RGB;
+		uint32_t size = Recorder::codec.encode(p_buf, Recorder::packed, Recorder::since >= CODEC_KEY);
 
-		case SDLK_COMMA:
-			Audio::volume = Audio::volume > 5 ? Audio::volume / 5 * 5 - 5 : 0;
-			break;
+		if (size + samples >= record.read) {
+			Recorder::codec.reset();
+			return p_buf;
+		}
 
-		case SDLK_PERIOD:
-			Audio::volume = Audio::volume < 95 ? Audio::volume / 5 * 5 + 5 : 100;
-			break;
+		memcpy(&Recorder::packed[size], &p_buf[FRAME_SIZE_RGB], samples);
 
-		// Window-specific controls
-		case SDLK_DOWN:
-			if (focusedScreen) {
-				focusedScreen->m_scale = focusedScreen->m_scale > 1.5 ? 
-					static_cast<int>(focusedScreen->m_scale / 0.5) * 0.5 - 0.5 : 1.0;
+		record.packed = size + samples;
+		Recorder::since = Codec::key(Recorder::packed) ? 1 : Recorder::since + 1;
+
+		return Recorder::packed;
+	}
+
+	static inline void finish() {
+		static const char padding[8] = {};
+		Footer footer = { (Recorder::offset + 7) / 8 * 8, Recorder::entries.size(), {} };
+
+		memcpy(footer.magic, Recorder::index_magic, sizeof(footer.magic));
+
+		Recorder::file.write(padding, footer.index - Recorder::offset);
+		Recorder::file.write(reinterpret_cast<const char*>(Recorder::entries.data()), Recorder::entries.size() * sizeof(Entry));
+		Recorder::file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+		if (!Recorder::file.good()) {
+			printf("[%s] Recording \"%s\" index write failed.\n", NAME, Recorder::path.c_str());
+		}
+	}
+};
+
+class Capture {
+public:
+	static inline UCHAR buf[BUF_COUNT][BUF_SIZE];
+	static inline ULONG read[BUF_COUNT];
+
+	static inline Source *p_source;
+
+	static inline bool starting = true;
+
+	static inline bool connected = false;
+	static inline bool disconnecting = false;
+
+	static inline bool auto_connect = false;
+
+	// any consumer besides audio and video, registered before the capture thread starts
+	static inline std::vector<Mailbox*> mailboxes;
+
+	static inline bool connect() {
+		if (Capture::connected) {
+			return true;
+		}
+
+		if (!Capture::p_source->open()) {
+			return false;
+		}
+
+		Mailbox::restart();
+
+		for (int i = 0; i < BUF_PENDING; ++i) {
+			if (!Capture::p_source->arm(i)) {
+				return false;
 			}
-			break;
+		}
 
-		case SDLK_UP:
-			if (focusedScreen) {
-				focusedScreen->m_scale = focusedScreen->m_scale < 4.0 ? 
-					static_cast<int>(focusedScreen->m_scale / 0.5) * 0.5 + 0.5 : 4.5;
+		return true;
+	}
+
+	// headless has a single consumer that sits in the mailboxes, so it passes no audio or video mailbox
+	static inline void stream(Mailbox *p_audio_mailbox, Mailbox *p_video_mailbox) {
+		while (g_running) {
+			if (!Capture::connected) {
+				if (Capture::auto_connect) {
+					if (!(Capture::connected = Capture::connect())) {
+						SDL_Delay(5000);
+					}
+				}
+
+				else {
+					SDL_Delay(5);
+				}
+
+				continue;
 			}
-			break;
 
-		case SDLK_LEFT:
-			if(g_kmsdrm) {
-				if(g_numdisplays == 1){
-					Video::screens[Video::Screen::Type::JOINT].m_fulltype = static_cast<Video::Screen::Fulltype>(((Video::screens[Video::Screen::Type::JOINT].m_fulltype - 1) % Video::Screen::Fulltype::MODS + Video::Screen::Fulltype::MODS) % Video::Screen::Fulltype::MODS);
-					Video::screens[Video::Screen::Type::JOINT].move();
+			if (Capture::disconnecting || !Capture::transfer()) {
+				Capture::disconnecting = Capture::connected = Capture::disconnect();
+
+				if (p_video_mailbox) {
+					p_video_mailbox->notify();
+				}
+
+				for (Mailbox *p_mailbox : Capture::mailboxes) {
+					p_mailbox->notify();
 				}
+
+				Capture::starting = true;
+				Capture::index = 0;
+
+				continue;
 			}
-			else if (focusedScreen) {
-				std::swap(focusedScreen->m_width, focusedScreen->m_height);
-				focusedScreen->rotateLeft();
-				focusedScreen->move();
+
+			if (p_audio_mailbox) {
+				p_audio_mailbox->notify();
 			}
-			break;
 
-		case SDLK_RIGHT:
-			if(g_kmsdrm){
-				if(g_numdisplays == 1){
-					Video::screens[Video::Screen::Type::JOINT].m_fulltype = static_cast<Video::Screen::Fulltype>(((Video::screens[Video::Screen::Type::JOINT].m_fulltype + 1) % Video::Screen::Fulltype::MODS + Video::Screen::Fulltype::MODS) % Video::Screen::Fulltype::MODS);
-					Video::screens[Video::Screen::Type::JOINT].move();
-				}
+			if (p_video_mailbox) {
+				p_video_mailbox->notify();
 			}
-			else if (focusedScreen) {
-				std::swap(focusedScreen->m_width, focusedScreen->m_height);
-				focusedScreen->rotateRight();
-				focusedScreen->move();
+
+			for (Mailbox *p_mailbox : Capture::mailboxes) {
+				p_mailbox->notify();
 			}
-			break;
 
-		case SDLK_LEFTBRACKET:
-		case SDL_SCANCODE_CUT:
-			if(g_kmsdrm && g_numdisplays > 1){
-				Video::screens[Video::Screen::Type::TOP].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				Video::screens[Video::Screen::Type::BOT].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				Video::screens[Video::Screen::Type::TOP].crop();
-				Video::screens[Video::Screen::Type::BOT].crop();
-				Video::screens[Video::Screen::Type::TOP].reset();
-				Video::screens[Video::Screen::Type::BOT].reset();
+			Capture::index = (Capture::index + 1) % BUF_COUNT;
+
+			if (Capture::starting) {
+				Capture::starting = Capture::index;
 			}
-			else if (focusedScreen) {
-				focusedScreen->m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				focusedScreen->crop();
-				focusedScreen->move();
+		}
+
+		Capture::disconnecting = Capture::connected = Capture::disconnect();
+	}
+
+private:
+	static inline int index = 0;
+
+	static inline bool disconnect() {
+		if (!Capture::connected) {
+			return false;
+		}
+
+		Capture::p_source->close();
+
+		return false;
+	}
+
+	// the slot completed BUF_HELD transfers ago is only handed back to the device once a newer one has been published
+	static inline bool transfer() {
+		int index = (Capture::index + BUF_PENDING) % BUF_COUNT;
+
+		if (!Capture::p_source->wait(Capture::index)) {
+			return false;
+		}
+
+		Stats::complete(Capture::index);
+		Recorder::tee(Capture::buf[Capture::index], Capture::read[Capture::index]);
+		Mailbox::publish(Capture::index);
+		Mailbox::arm(index);
+
+		return Capture::p_source->arm(index);
+	}
+};
+
+// keeps the last seconds of transfers in memory for saving after the fact, every frame packed by the codec as its
+// difference to the previous one, or on its own once a second so the oldest frame kept can always be rebuilt. the memory
+// is one fixed arena used as a ring, so dropping the oldest transfer only moves the tail, and a clip is saved by a thread
+// of its own, as a packed recording whose transfers are kept until it is done with them
+class Clip {
+public:
+	static inline int seconds = 0;
+	static inline int memory = CLIP_MEMORY;
+
+	static inline Mailbox mailbox{Mailbox::Policy::EVERY};
+
+	static inline void open() {
+		Clip::arena.resize(static_cast<size_t>(Clip::memory) * 1024 * 1024);
+		Clip::entries.resize(Clip::seconds * FRAMERATE_LIMIT + CODEC_KEY);
+
+		// there are no keys without a window, so a clip can be saved with a signal as well
+		::signal(SIGUSR1, Clip::signal);
+
+		Capture::mailboxes.push_back(&Clip::mailbox);
+		Clip::thread = std::thread(Clip::run);
+
+		printf("[%s] Keeping the last %d seconds in up to %d MB for clips.\n", NAME, Clip::seconds, Clip::memory);
+	}
+
+	static inline void close() {
+		if (!Clip::thread.joinable()) {
+			return;
+		}
+
+		Clip::thread.join();
+
+		if (Clip::saver.joinable()) {
+			Clip::saver.join();
+		}
+
+		printf("[%s] Clips dropped %llu and overran %llu transfers, and had no room for %llu.\n", NAME,
+			static_cast<unsigned long long>(Clip::mailbox.m_drops), static_cast<unsigned long long>(Clip::mailbox.m_overruns), static_cast<unsigned long long>(Clip::overflows));
+	}
+
+	// from any thread, the clip being taken with the next transfer
+	static inline void save() {
+		if (Clip::seconds) {
+			Clip::requested.store(true);
+		}
+	}
+
+private:
+	friend class Bench;
+
+	// where a transfer is in the arena, its packed frame being followed by its samples
+	struct Entry {
+		uint64_t offset;
+		uint64_t time;
+		uint32_t size;
+		uint32_t read;
+		bool key;
+	};
+
+	static inline std::vector<UCHAR> arena;
+	static inline std::vector<Entry> entries;
+
+	// the transfers from first to next are kept, taking up the arena from the first one's offset to head
+	static inline uint64_t first = 0;
+	static inline uint64_t next = 0;
+	static inline uint64_t head = 0;
+	static inline int since = CODEC_KEY;
+
+	static inline Codec codec;
+
+	static inline std::thread thread;
+	static inline std::thread saver;
+
+	static inline std::atomic<bool> requested{false};
+	static inline std::atomic<bool> saving{false};
+
+	// the transfers from this one on are still to be saved, and can't be dropped yet
+	static inline std::atomic<uint64_t> held{UINT64_MAX};
+
+	static inline uint64_t overflows = 0;
+
+	static inline void signal(int) {
+		Clip::save();
+	}
+
+	static inline void run() {
+		while (g_running) {
+			int ready = Clip::mailbox.take(5);
+
+			if (!Clip::saving.load() && Clip::requested.exchange(false)) {
+				Clip::begin();
 			}
-			break;
 
-		case SDLK_RIGHTBRACKET:
-		case SDL_SCANCODE_PASTE:
-			if(g_kmsdrm && g_numdisplays > 1){
-				Video::screens[Video::Screen::Type::TOP].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				Video::screens[Video::Screen::Type::BOT].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				Video::screens[Video::Screen::Type::TOP].crop();
-				Video::screens[Video::Screen::Type::BOT].crop();
-				Video::screens[Video::Screen::Type::TOP].reset();
-				Video::screens[Video::Screen::Type::BOT].reset();
+			if (ready == TRANSFER_ABORT || Capture::starting || Capture::read[ready] < FRAME_SIZE_RGB) {
+				continue;
 			}
-			else if (focusedScreen) {
-				focusedScreen->m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
-				focusedScreen->crop();
-				focusedScreen->move();
+
+			Clip::store(ready);
+		}
+	}
+
+	static inline void store(int ready) {
+		uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		while (Clip::first < Clip::next && now - Clip::entries[Clip::first % Clip::entries.size()].time > Clip::seconds * 1000000000ULL) {
+			if (!Clip::drop()) {
+				break;
 			}
-			break;
 		}
+
+		uint64_t offset;
+
+		if (!Clip::reserve(CLIP_BOUND, &offset)) {
+			++Clip::overflows;
+			Clip::mailbox.release();
+			return;
+		}
+
+		// nothing older being kept means nothing to take the difference to
+		const UCHAR *p_in = Capture::buf[ready];
+		UCHAR *p_out = &Clip::arena[offset];
+
+		uint32_t packed = Clip::codec.encode(p_in, p_out, Clip::first == Clip::next || Clip::since >= CODEC_KEY);
+		uint32_t samples = std::min<ULONG>(Capture::read[ready] - FRAME_SIZE_RGB, SAMPLE_SIZE_8);
+
+		memcpy(p_out + packed, &p_in[FRAME_SIZE_RGB], samples);
+
+		// a transfer refilled while it was being stored is left out, and the frame it tore can't be the next one's reference
+		if (!Clip::mailbox.release()) {
+			Clip::codec.reset();
+			return;
+		}
+
+		bool key = Codec::key(p_out);
+
+		Clip::entries[Clip::next % Clip::entries.size()] = { offset, now, packed + samples, FRAME_SIZE_RGB + samples, key };
+		Clip::head = offset + packed + samples;
+		Clip::since = key ? 1 : Clip::since + 1;
+
+		++Clip::next;
 	}
 
-	static inline void handleKeyUp(const SDL_Event& event) {
-		Screen* focusedScreen = getFocusedScreen();
-		
-		switch (event.key.keysym.sym) {
-		// Global controls
-		case SDLK_ESCAPE:
-			if (!Capture::auto_connect) {
-				Capture::connected ? Capture::disconnecting = true : Capture::connected = Capture::connect();
+	// the oldest transfers make room until there is enough in one piece, either after the newest one or back at the start
+	static inline bool reserve(uint64_t size, uint64_t *p_offset) {
+		uint64_t capacity = Clip::arena.size();
+
+		while (true) {
+			if (Clip::first == Clip::next) {
+				*p_offset = Clip::head = 0;
+				return size <= capacity;
+			}
+
+			uint64_t tail = Clip::entries[Clip::first % Clip::entries.size()].offset;
+
+			if (Clip::next - Clip::first < Clip::entries.size()) {
+				if (Clip::head > tail && capacity - Clip::head >= size) {
+					*p_offset = Clip::head;
+					return true;
+				}
+
+				if (Clip::head > tail && tail >= size) {
+					*p_offset = 0;
+					return true;
+				}
+
+				if (Clip::head <= tail && tail - Clip::head >= size) {
+					*p_offset = Clip::head;
+					return true;
+				}
+			}
+
+			if (!Clip::drop()) {
+				return false;
+			}
+		}
+	}
+
+	// drops the oldest transfer along with the ones up to the next key frame, which every clip starts on, and only when the
+	// saver is done with all of them
+	static inline bool drop() {
+		uint64_t until = Clip::first + 1;
+
+		while (until < Clip::next && !Clip::entries[until % Clip::entries.size()].key) {
+			++until;
+		}
+
+		if (until > Clip::held.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		Clip::first = until;
+
+		return true;
+	}
+
+	static inline void begin() {
+		if (Clip::first == Clip::next) {
+			printf("[%s] Clip has nothing to save yet.\n", NAME);
+			return;
+		}
+
+		if (Clip::saver.joinable()) {
+			Clip::saver.join();
+		}
+
+		char name[64];
+		time_t now = time(nullptr);
+		strftime(name, sizeof(name), "%Y%m%d-%H%M%S.raw", localtime(&now));
+
+		Clip::held.store(Clip::first);
+		Clip::saving.store(true);
+
+		Clip::saver = std::thread(Clip::write, Clip::first, Clip::next, CONF_DIR + "clips/" + NAME + "-" + name);
+	}
+
+	// the clip is written as a recording, each transfer being let go of as soon as it is
+	static inline void write(uint64_t first, uint64_t last, std::string path) {
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(Recorder::magic, sizeof(Recorder::magic));
+
+		uint64_t start = Clip::entries[first % Clip::entries.size()].time;
+
+		for (uint64_t i = first; i < last; ++i) {
+			const Entry &entry = Clip::entries[i % Clip::entries.size()];
+			Recorder::Record record = { entry.time - start, entry.read, entry.size };
+
+			file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+			file.write(reinterpret_cast<const char*>(&Clip::arena[entry.offset]), entry.size);
+
+			Clip::held.store(i + 1, std::memory_order_release);
+		}
+
+		file.close();
+
+		if (file.fail()) {
+			printf("[%s] Clip \"%s\" write failed.\n", NAME, path.c_str());
+		}
+
+		else {
+			printf("[%s] Clip \"%s\" saved %llu transfers.\n", NAME, path.c_str(), static_cast<unsigned long long>(last - first));
+		}
+
+		Clip::held.store(UINT64_MAX);
+		Clip::saving.store(false);
+	}
+};
+
+#ifndef XX3DSDL_NO_DEVICE
+class Device : public Source {
+public:
+	bool open() override {
+		if (FT_Create(const_cast<char*>(PRODUCT_1), FT_OPEN_BY_DESCRIPTION, &this->m_handle) && FT_Create(const_cast<char*>(PRODUCT_2), FT_OPEN_BY_DESCRIPTION, &this->m_handle)) {
+			printf("[%s] Create failed.\n", NAME);
+			return false;
+		}
+
+		UCHAR buf[4] = {0x40, 0x80, 0x00, 0x00};
+		ULONG written = 0;
+
+		FT_AbortPipe(this->m_handle, BULK_OUT);
+		FT_AbortPipe(this->m_handle, BULK_IN);
+		FT_FlushPipe(this->m_handle, BULK_OUT);
+		FT_FlushPipe(this->m_handle, BULK_IN);
+		FT_ClearStreamPipe(this->m_handle, false, false, BULK_IN);
+		FT_ClearStreamPipe(this->m_handle, false, false, BULK_OUT);
+
+		if (FT_WritePipe(this->m_handle, BULK_OUT, buf, 4, &written, 0)) {
+			printf("[%s] Write failed.\n", NAME);
+			return false;
+		}
+		
+		UCHAR buf2[16] = {0x98, 0x05, 0x9f, 0x0};
+		ULONG returned = 0;
+		
+		if (FT_WritePipe(this->m_handle, BULK_OUT, buf2, 4, &returned, 0)) {
+			printf("[%s] Write bsId failed.\n", NAME);
+			return false;
+		}
+
+		if (FT_ReadPipe(this->m_handle, BULK_IN, buf2, 16, &returned, 0)) {
+			printf("[%s] Read bsId failed.\n", NAME);
+			return false;
+		}
+
+		uint32_t bsId = (((((buf2[4] << 8) | buf2[3]) << 8) | buf2[2]) << 8) | buf2[1];
+		if((bsId & 0xf0f0ff) != 0xc0b0a1){
+			printf("[%s] bsId validation failed\n", NAME);
+			return false;
+		}
+
+		buf[1] = 0x00;
+
+		if (FT_WritePipe(this->m_handle, BULK_OUT, buf, 4, &written, 0)) {
+			printf("[%s] Write failed.\n", NAME);
+			return false;
+		}
+
+		if (FT_SetStreamPipe(this->m_handle, false, false, BULK_IN, BUF_SIZE)) {
+			printf("[%s] Stream failed.\n", NAME);
+			return false;
+		}
+
+		for (int i = 0; i < BUF_COUNT; ++i) {
+			if (FT_InitializeOverlapped(this->m_handle, &this->m_overlap[i])) {
+				printf("[%s] Initialize failed.\n", NAME);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void close() override {
+		if (this->m_handle == nullptr) {
+			printf("[%s] Handle is null, skipping disconnect.\n", NAME);
+			return;
+		}
+		SDL_Delay(100);
+
+		for (int i = 0; i < BUF_COUNT; ++i) {
+			if (FT_ReleaseOverlapped(this->m_handle, &this->m_overlap[i])) {
+				printf("[%s] Release failed.\n", NAME);
+			}
+		}
+
+		SDL_Delay(50);
+		
+		if (FT_Close(this->m_handle)) {
+			printf("[%s] Close failed.\n", NAME);
+		}
+	}
+
+	bool arm(int index) override {
+		if (FT_ReadPipeAsync(this->m_handle, FIFO_CHANNEL, Capture::buf[index], BUF_SIZE, &Capture::read[index], &this->m_overlap[index]) != FT_IO_PENDING) {
+			printf("[%s] Read failed.\n", NAME);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool wait(int index) override {
+		if (FT_GetOverlappedResult(this->m_handle, &this->m_overlap[index], &Capture::read[index], true) == FT_IO_INCOMPLETE && FT_AbortPipe(this->m_handle, BULK_IN)) {
+			printf("[%s] Abort failed.\n", NAME);
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	FT_HANDLE m_handle = nullptr;
+	OVERLAPPED m_overlap[BUF_COUNT];
+};
+#endif
+
+// replays a recording the recorder made straight out of a memory map of it, every transfer at the cadence it was captured at.
+// the index at its end makes any point in it a binary search away, and is rebuilt from the record headers when it is missing
+class Replay : public Source {
+public:
+	// set from the render thread, a paused replay only moving on a step or a jump
+	static inline bool active = false;
+	static inline std::atomic<bool> paused{false};
+	static inline std::atomic<int> steps{0};
+	static inline std::atomic<int> speed{1};
+	static inline std::atomic<int64_t> jump{0};
+
+	Replay(std::string path, bool fast) : m_path(path), m_fast(fast) {
+		Replay::active = true;
+	}
+
+	bool open() override {
+		int fd = ::open(this->m_path.c_str(), O_RDONLY);
+
+		if (fd < 0) {
+			printf("[%s] Replay \"%s\" open failed.\n", NAME, this->m_path.c_str());
+			return false;
+		}
+
+		struct stat status;
+
+		if (fstat(fd, &status) || static_cast<size_t>(status.st_size) < sizeof(Recorder::magic)) {
+			printf("[%s] Replay \"%s\" is not a recording.\n", NAME, this->m_path.c_str());
+			::close(fd);
+			return false;
+		}
+
+		this->m_size = status.st_size;
+		void *p_map = mmap(nullptr, this->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+
+		if (p_map == MAP_FAILED) {
+			printf("[%s] Replay \"%s\" map failed.\n", NAME, this->m_path.c_str());
+			return false;
+		}
+
+		this->p_map = static_cast<const UCHAR*>(p_map);
+
+		if (memcmp(this->p_map, Recorder::magic, sizeof(Recorder::magic))) {
+			printf("[%s] Replay \"%s\" is not a recording.\n", NAME, this->m_path.c_str());
+			this->close();
+			return false;
+		}
+
+		this->index();
+
+		if (!this->m_count) {
+			printf("[%s] Replay is empty.\n", NAME);
+			this->close();
+			return false;
+		}
+
+		this->m_position = 0;
+		this->m_anchor = true;
+
+		return true;
+	}
+
+	void close() override {
+		if (this->p_map) {
+			munmap(const_cast<UCHAR*>(this->p_map), this->m_size);
+			this->p_map = nullptr;
+		}
+
+		this->p_index = nullptr;
+		this->m_entries.clear();
+		this->m_count = 0;
+		this->m_decoded = UINT64_MAX;
+	}
+
+	// the file is read on demand, so there is nothing to queue ahead
+	bool arm(int index) override {
+		return true;
+	}
+
+	bool wait(int index) override {
+		while (Replay::paused && !Replay::steps && !Replay::jump) {
+			if (!g_running || Capture::disconnecting) {
+				return false;
+			}
+
+			SDL_Delay(5);
+		}
+
+		this->seek();
+
+		const Recorder::Entry &entry = this->p_index[this->m_position];
+
+		if (!this->payload(entry)) {
+			printf("[%s] Replay record is corrupt.\n", NAME);
+			return false;
+		}
+
+		int speed = Replay::speed;
+
+		if (this->m_anchor || speed != this->m_speed) {
+			this->m_anchor = false;
+			this->m_speed = speed;
+			this->m_offset = entry.time;
+			this->m_start = std::chrono::steady_clock::now();
+		}
+
+		// keep the original cadence, stalls included, unless replaying as fast as possible or stepping through it
+		if (Replay::paused) {
+			if (Replay::steps > 0) {
+				--Replay::steps;
+			}
+
+			this->m_anchor = true;
+		}
+
+		else if (!this->m_fast) {
+			std::this_thread::sleep_until(this->m_start + std::chrono::nanoseconds((entry.time - this->m_offset) / speed));
+		}
+
+		if (!entry.packed) {
+			memcpy(Capture::buf[index], this->payload(entry), entry.read);
+		}
+
+		else if (!this->unpack(this->m_position, Capture::buf[index])) {
+			printf("[%s] Replay frame is corrupt.\n", NAME);
+			return false;
+		}
+
+		Capture::read[index] = entry.read;
+
+		this->advance(speed);
+
+		return true;
+	}
+
+private:
+	friend class Convert;
+
+	std::string m_path;
+
+	const UCHAR *p_map = nullptr;
+	size_t m_size = 0;
+
+	// points into the map when the recording has an index, or at the one rebuilt from its records otherwise
+	const Recorder::Entry *p_index = nullptr;
+	std::vector<Recorder::Entry> m_entries;
+	uint64_t m_count = 0;
+
+	uint64_t m_position = 0;
+
+	bool m_fast;
+	bool m_anchor = true;
+	int m_speed = 1;
+
+	uint64_t m_offset = 0;
+	std::chrono::steady_clock::time_point m_start;
+
+	// the packed frame decoded last, which the next one usually carries on from
+	Codec m_codec;
+	uint64_t m_decoded = UINT64_MAX;
+
+	static inline uint32_t length(uint32_t read, uint32_t packed) {
+		return packed ? packed : read;
+	}
+
+	// a record's payload, or null when it doesn't fit the file or its lengths make no sense
+	const UCHAR *payload(const Recorder::Entry &entry) {
+		if (entry.read > BUF_SIZE || entry.packed > CODEC_BOUND + SAMPLE_SIZE_8 || (entry.packed && entry.read < FRAME_SIZE_RGB) ||
+			entry.offset + sizeof(Recorder::Record) + Replay::length(entry.read, entry.packed) > this->m_size) {
+			return nullptr;
+		}
+
+		return this->p_map + entry.offset + sizeof(Recorder::Record);
+	}
+
+	// a packed frame is rebuilt from the last key frame at or before it, or from the one decoded last when that's closer,
+	// and its samples are stored after it as they are
+	bool unpack(uint64_t position, UCHAR *p_out) {
+		uint64_t from = position;
+
+		while (from > 0 && !(this->p_index[from].packed && this->payload(this->p_index[from]) && Codec::key(this->payload(this->p_index[from])))) {
+			--from;
+		}
+
+		if (this->m_decoded != UINT64_MAX && this->m_decoded >= from && this->m_decoded < position) {
+			from = this->m_decoded + 1;
+		}
+
+		this->m_decoded = UINT64_MAX;
+
+		for (uint64_t i = from; i <= position; ++i) {
+			const Recorder::Entry &entry = this->p_index[i];
+			const UCHAR *p_payload = this->payload(entry);
+
+			if (!entry.packed) {
+				continue;
+			}
+
+			if (!p_payload || !this->m_codec.decode(p_payload, entry.packed, i == position ? p_out : nullptr)) {
+				return false;
+			}
+		}
+
+		const Recorder::Entry &entry = this->p_index[position];
+		uint32_t samples = entry.read - FRAME_SIZE_RGB;
+
+		if (entry.packed < samples) {
+			return false;
+		}
+
+		memcpy(&p_out[FRAME_SIZE_RGB], this->payload(entry) + entry.packed - samples, samples);
+		this->m_decoded = position;
+
+		return true;
+	}
+
+	void index() {
+		Recorder::Footer footer;
+
+		if (this->m_size >= sizeof(Recorder::magic) + sizeof(footer)) {
+			memcpy(&footer, this->p_map + this->m_size - sizeof(footer), sizeof(footer));
+
+			if (!memcmp(footer.magic, Recorder::index_magic, sizeof(footer.magic)) && footer.index % 8 == 0 && footer.index <= this->m_size - sizeof(footer) &&
+				footer.count == (this->m_size - sizeof(footer) - footer.index) / sizeof(Recorder::Entry)) {
+				this->p_index = reinterpret_cast<const Recorder::Entry*>(this->p_map + footer.index);
+				this->m_count = footer.count;
+				return;
+			}
+		}
+
+		// only the headers get touched, every payload being skipped over
+		size_t offset = sizeof(Recorder::magic);
+		Recorder::Record record;
+
+		while (offset + sizeof(record) <= this->m_size) {
+			memcpy(&record, this->p_map + offset, sizeof(record));
+
+			if (!this->payload({ offset, record.time, record.read, record.packed })) {
+				break;
+			}
+
+			this->m_entries.push_back({ offset, record.time, record.read, record.packed });
+			offset += sizeof(record) + Replay::length(record.read, record.packed);
+		}
+
+		printf("[%s] Replay \"%s\" has no index, rebuilt it from %llu records.\n", NAME, this->m_path.c_str(), static_cast<unsigned long long>(this->m_entries.size()));
+
+		this->p_index = this->m_entries.data();
+		this->m_count = this->m_entries.size();
+	}
+
+	// the first record at or after a time, clamped to the recording
+	uint64_t find(uint64_t time) {
+		const Recorder::Entry *p_entry = std::lower_bound(this->p_index, this->p_index + this->m_count, time, [](const Recorder::Entry &entry, uint64_t time) {
+			return entry.time < time;
+		});
+
+		return std::min<uint64_t>(p_entry - this->p_index, this->m_count - 1);
+	}
+
+	void seek() {
+		int64_t jump = Replay::jump.exchange(0);
+
+		if (jump) {
+			int64_t time = static_cast<int64_t>(this->p_index[this->m_position].time) + jump;
+			this->m_position = this->find(std::max<int64_t>(0, time));
+			this->m_anchor = true;
+		}
+	}
+
+	// fast forwarding skips ahead by the speed's worth of recording every transfer, which keeps the original cadence,
+	// and the recording loops when it reaches its end
+	void advance(int speed) {
+		uint64_t position = this->m_position + 1;
+
+		if (speed > 1 && position < this->m_count) {
+			const Recorder::Entry &entry = this->p_index[this->m_position];
+			position = std::max(position, this->find(entry.time + (this->p_index[position].time - entry.time) * speed));
+		}
+
+		if (position >= this->m_count) {
+			position = 0;
+			this->m_anchor = true;
+		}
+
+		this->m_position = position;
+
+		// the next transfer's pages get read in while this one is waiting its turn
+		const Recorder::Entry &next = this->p_index[position];
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t from = next.offset / page * page;
+
+		if (this->payload(next)) {
+			madvise(const_cast<UCHAR*>(this->p_map) + from, next.offset + sizeof(Recorder::Record) + Replay::length(next.read, next.packed) - from, MADV_WILLNEED);
+		}
+	}
+};
+
+// fixed size single producer single consumer ring of interleaved samples, the playback thread writing and the sdl
+// callback reading, each side owning its own index on its own cache line so neither ever waits on the other
+class Ring {
+public:
+	static_assert((RING_SIZE & (RING_SIZE - 1)) == 0);
+
+	// writes all of the samples or none of them
+	bool write(const Sint16 *p_in, int count) {
+		size_t head = this->m_head.load(std::memory_order_relaxed);
+		size_t tail = this->m_tail.load(std::memory_order_acquire);
+
+		if (RING_SIZE - (head - tail) < static_cast<size_t>(count)) {
+			return false;
+		}
+
+		int first = std::min(count, static_cast<int>(RING_SIZE - head % RING_SIZE));
+
+		memcpy(&this->m_buf[head % RING_SIZE], p_in, first * sizeof(Sint16));
+		memcpy(this->m_buf, p_in + first, (count - first) * sizeof(Sint16));
+
+		this->m_head.store(head + count, std::memory_order_release);
+
+		return true;
+	}
+
+	// reads up to count samples and returns how many there were
+	int read(Sint16 *p_out, int count) {
+		size_t tail = this->m_tail.load(std::memory_order_relaxed);
+		size_t head = this->m_head.load(std::memory_order_acquire);
+
+		count = std::min(count, static_cast<int>(head - tail));
+
+		int first = std::min(count, static_cast<int>(RING_SIZE - tail % RING_SIZE));
+
+		memcpy(p_out, &this->m_buf[tail % RING_SIZE], first * sizeof(Sint16));
+		memcpy(p_out + first, this->m_buf, (count - first) * sizeof(Sint16));
+
+		this->m_tail.store(tail + count, std::memory_order_release);
+
+		return count;
+	}
+
+	// fill level in samples, exact from either side and a snapshot from anywhere else
+	int size() {
+		return this->m_head.load(std::memory_order_acquire) - this->m_tail.load(std::memory_order_acquire);
+	}
+
+	// only safe while the reading side is stopped
+	void clear() {
+		this->m_tail.store(this->m_head.load());
+	}
+
+private:
+	alignas(CACHE_LINE) std::atomic<size_t> m_head{0};
+	alignas(CACHE_LINE) std::atomic<size_t> m_tail{0};
+	alignas(CACHE_LINE) Sint16 m_buf[RING_SIZE];
+};
+
+// linear resampler from the capture's non integer rate to the device's own rate, steering its ratio by at most half a
+// percent so the ring settles on the target latency instead of drifting until chunks have to be dropped
+class Resampler {
+public:
+	int m_target = 0;
+
+	void reset(int in_rate, int out_rate, int target) {
+		this->m_ratio = this->m_step = static_cast<double>(in_rate) / out_rate;
+		this->m_target = target;
+		this->m_fill = target;
+		this->m_integral = 0.0;
+		this->m_position = 0.0;
+
+		memset(this->m_last, 0, sizeof(this->m_last));
+	}
+
+	// fill is the ring level in samples the output is about to be queued behind, returns the frames written
+	int process(const Sint16 *p_in, int frames, Sint16 *p_out, int capacity, int fill) {
+		if (frames < 1) {
+			return 0;
+		}
+
+		this->steer(fill);
+
+		int count = 0;
+
+		for (; this->m_position < frames - 1 && count < capacity; this->m_position += this->m_step, ++count) {
+			int i = static_cast<int>(std::floor(this->m_position));
+			double f = this->m_position - i;
+
+			const Sint16 *p_a = i < 0 ? this->m_last : &p_in[AUDIO_CHANNELS * i];
+			const Sint16 *p_b = &p_in[AUDIO_CHANNELS * (i + 1)];
+
+			for (int c = 0; c < AUDIO_CHANNELS; ++c) {
+				p_out[AUDIO_CHANNELS * count + c] = static_cast<Sint16>(std::lround(p_a[c] + (p_b[c] - p_a[c]) * f));
+			}
+		}
+
+		this->m_position -= frames;
+		memcpy(this->m_last, &p_in[AUDIO_CHANNELS * (frames - 1)], sizeof(this->m_last));
+
+		return count;
+	}
+
+private:
+	static constexpr double SMOOTHING = 0.05;
+	static constexpr double GAIN = 0.002;
+	static constexpr double INTEGRAL = 0.00002;
+	static constexpr double LIMIT = 0.005;
+
+	double m_ratio = 1.0;
+	double m_step = 1.0;
+	double m_fill = 0.0;
+	double m_integral = 0.0;
+	double m_position = 0.0;
+
+	Sint16 m_last[AUDIO_CHANNELS];
+
+	// the fill level is smoothed since the device drains the ring a whole callback at a time
+	void steer(int fill) {
+		this->m_fill += (fill - this->m_fill) * Resampler::SMOOTHING;
+
+		double error = (this->m_fill - this->m_target) / this->m_target;
+
+		this->m_integral = std::clamp(this->m_integral + error * Resampler::INTEGRAL, -Resampler::LIMIT, Resampler::LIMIT);
+		this->m_step = this->m_ratio * (1.0 + std::clamp(error * Resampler::GAIN + this->m_integral, -Resampler::LIMIT, Resampler::LIMIT));
+	}
+};
+
+class Audio {
+public:
+	static inline Audio *p_audio;
+
+	static inline int volume = 100;
+	static inline bool mute = false;
+
+	static inline int target = AUDIO_TARGET;
+
+	static inline int frames = AUDIO_FRAMES;
+	static inline bool adaptive = false;
+
+	static inline std::atomic<unsigned> underruns{0};
+
+	static inline Mailbox mailbox{Mailbox::Policy::EVERY};
+	static inline Ring ring;
+
+	static inline SDL_AudioDeviceID device_id;
+	static inline SDL_AudioSpec audio_spec;
+
+	Audio() {
+		SDL_AudioSpec wanted_spec;
+		SDL_memset(&wanted_spec, 0, sizeof(wanted_spec));
+		wanted_spec.freq = AUDIO_RATE;
+		wanted_spec.format = AUDIO_S16SYS;
+		wanted_spec.channels = AUDIO_CHANNELS;
+		wanted_spec.samples = Audio::frames;
+		wanted_spec.callback = audio_callback;
+		wanted_spec.userdata = this;
+
+		// resampling straight to the device's own rate leaves sdl nothing to convert
+		device_id = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &audio_spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+		if (device_id == 0) {
+			printf("[%s] SDL_OpenAudioDevice failed: %s\n", NAME, SDL_GetError());
+			return;
+		}
+
+		// the ring has to hold a callback and a half at the very least, or every callback would find it short
+		Audio::resampler.reset(SAMPLE_RATE, audio_spec.freq, std::max(Audio::target * audio_spec.freq / 1000, audio_spec.samples * 3 / 2) * AUDIO_CHANNELS);
+		Audio::priming = true;
+
+		SDL_PauseAudioDevice(device_id, 0);
+		SDL_Delay(100);  // Give time for callback to be called
+	}
+
+	static inline void playback() {
+		while (g_running) {
+			int ready = Audio::mailbox.take(5);
+
+			if (ready == TRANSFER_ABORT) {
+				continue;
+			}
+
+			if (Capture::starting) {
+				Audio::reset();
+				continue;
+			}
+
+			if (!Audio::load(&Capture::buf[ready][FRAME_SIZE_RGB], &Capture::read[ready])) {
+				continue;
+			}
+
+			Audio::adapt();
+
+			if (Audio::starting) {
+				Audio::starting = false; 
+			}
+
+			Audio::unblock();
+		}
+
+		Audio::unblock();
+		delete Audio::p_audio;
+	}
+
+	static inline void dispatch() {
+		const char *kernel = "scalar";
+
+#ifdef SIMD_X86
+		if (SDL_HasSSE2()) {
+			Audio::p_scale = Audio::scale_sse2;
+			kernel = "sse2";
+		}
+#endif
+
+#ifdef SIMD_NEON
+		if (SDL_HasNEON()) {
+			Audio::p_scale = Audio::scale_neon;
+			kernel = "neon";
+		}
+#endif
+
+		printf("[%s] Using %s audio gain.\n", NAME, kernel);
+	}
+
+	static inline void report(const char *p_state) {
+		printf("[%s] Audio buffer %s %d frames (%.1f ms at %d Hz), %u underruns.\n", NAME, p_state, Audio::audio_spec.samples,
+			1000.0 * Audio::audio_spec.samples / std::max(1, Audio::audio_spec.freq), Audio::audio_spec.freq, Audio::underruns.load());
+	}
+
+	static inline void audio_callback(void *userdata, Uint8 *stream, int len) {
+		Audio *audio = static_cast<Audio*>(userdata);
+
+		int samples_needed = len / sizeof(Sint16);
+		Sint16 *output = reinterpret_cast<Sint16*>(stream);
+
+		// whenever the ring runs dry, hold off until the target latency is queued again rather than stuttering on every chunk
+		if (Audio::priming && Audio::ring.size() < Audio::resampler.m_target) {
+			SDL_memset(stream, 0, len);
+			return;
+		}
+
+		Audio::priming = false;
+
+		if (Stats::enabled) {
+			Stats::ring.add(Audio::ring.size() / AUDIO_CHANNELS);
+		}
+
+		int samples_written = Audio::ring.read(output, samples_needed);
+
+		// not droping audio when muted to avoid audio noise when unmuting, and non linear volume otherwise
+		int level = Audio::mute ? 0 : Audio::volume * Audio::volume * GAIN_UNITY / 10000;
+
+		// ramping across the callback from the level the last one ended on keeps volume steps from clicking
+		if (level != Audio::level || level != GAIN_UNITY) {
+			if (level == 0 && Audio::level == 0) {
+				SDL_memset(output, 0, samples_written * sizeof(Sint16));
+			}
+
+			else {
+				Audio::p_scale(output, samples_written, Audio::level, level);
+			}
+		}
+
+		Audio::level = level;
+
+		// Fill remaining with silence if needed
+		if (samples_written < samples_needed) {
+			SDL_memset(output + samples_written, 0, (samples_needed - samples_written) * sizeof(Sint16));
+			Audio::priming = true;
+			Audio::underruns.fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		// Don't call unblock here - it's causing issues
+		// Audio::unblock();
+	}
+
+private:
+	friend class Bench;
+
+	static inline Sint16 buf[SAMPLE_SIZE_16];
+	static inline Sint16 out[SAMPLE_SIZE_16 * 8];
+
+	static inline Resampler resampler;
+	static inline std::atomic<bool> priming{true};
+
+	// q15 gain the last callback ended on, only ever touched by the callback
+	static inline int level = GAIN_UNITY;
+
+	static inline bool starting = true;
+
+	static inline std::promise<void> barrier;
+	static inline bool blocked = false;
+
+	static inline unsigned seen = 0;
+	static inline Uint32 window = 0;
+	static inline Uint32 arrived = 0;
+
+	// starts from a small callback buffer and only doubles it when underruns keep happening within a window, the ones
+	// the capture caused by stalling or reconnecting not counting against it
+	static inline void adapt() {
+		Uint32 now = SDL_GetTicks();
+		unsigned underruns = Audio::underruns.load(std::memory_order_relaxed);
+
+		bool stalled = now - Audio::arrived > UNDERRUN_STALL;
+		Audio::arrived = now;
+
+		if (!Audio::adaptive || stalled || now - Audio::window > UNDERRUN_WINDOW) {
+			Audio::seen = underruns;
+			Audio::window = now;
+			return;
+		}
+
+		if (underruns - Audio::seen < UNDERRUN_LIMIT || Audio::frames >= AUDIO_FRAMES_MAX) {
+			return;
+		}
+
+		Audio::frames *= 2;
+		Audio::seen = underruns;
+		Audio::window = now;
+
+		Audio::reset();
+		Audio::report("raised to");
+	}
+
+	static inline void reset() {
+		Audio::unblock();
+		delete Audio::p_audio;
+
+		Audio::ring.clear();
+		Audio::p_audio = new Audio();
+
+		Audio::starting = true;
+	}
+
+	static inline bool load(UCHAR *p_buf, ULONG *p_read) {
+		if (*p_read <= FRAME_SIZE_RGB) {
+			return false;
+		}
+
+		int fill = Audio::ring.size();
+
+		// a burst after a stall is more than the resampler could steer back in reasonable time. long targets would put that
+		// past what the ring holds, so it also stops where the largest chunk the resampler writes would no longer fit
+		if (fill > std::min(4 * Audio::resampler.m_target, RING_SIZE - static_cast<int>(sizeof(Audio::out) / sizeof(Sint16)))) {
+			return false;
+		}
+
+		Audio::map(p_buf, Audio::buf);
+
+		if (!Audio::mailbox.release()) {
+			return false;
+		}
+
+		int frames = Audio::resampler.process(Audio::buf, (*p_read - FRAME_SIZE_RGB) / 2 / AUDIO_CHANNELS, Audio::out, sizeof(Audio::out) / sizeof(Sint16) / AUDIO_CHANNELS, fill);
+
+		return Audio::ring.write(Audio::out, frames * AUDIO_CHANNELS);
+	}
+
+	// the capture's samples are little endian, so unpacking them is a plain copy on little endian hosts
+	static inline void map(UCHAR *p_in, Sint16 *p_out) {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+		memcpy(p_out, p_in, SAMPLE_SIZE_8);
+#else
+		for (int i = 0; i < SAMPLE_SIZE_16; ++i) {
+			p_out[i] = p_in[i * 2 + 1] << 8 | p_in[i * 2];
+		}
+#endif
+	}
+
+	// q15 gain of a block of GAIN_BLOCK samples, the ramp stepping once per block and landing exactly on the new level
+	static inline int ramp(int from, int to, int block, int blocks) {
+		return std::min(GAIN_UNITY - 1, from + (to - from) * (block + 1) / blocks);
+	}
+
+	// scalar fallback and the reference the simd gain kernels have to match bit for bit
+	static inline void scale(Sint16 *p_samples, int count, int from, int to) {
+		int blocks = (count + GAIN_BLOCK - 1) / GAIN_BLOCK;
+
+		for (int i = 0; i < count; ++i) {
+			int gain = Audio::ramp(from, to, i / GAIN_BLOCK, blocks);
+
+			p_samples[i] = std::clamp((p_samples[i] * gain + (1 << 14)) >> 15, -32768, 32767);
+		}
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET("sse2") static inline void scale_sse2(Sint16 *p_samples, int count, int from, int to) {
+		const __m128i round = _mm_set1_epi32(1 << 14);
+
+		int blocks = (count + GAIN_BLOCK - 1) / GAIN_BLOCK;
+		int i = 0;
+
+		for (; i + GAIN_BLOCK <= count; i += GAIN_BLOCK) {
+			__m128i gain = _mm_set1_epi16(Audio::ramp(from, to, i / GAIN_BLOCK, blocks));
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<__m128i*>(&p_samples[i]));
+
+			__m128i lo = _mm_mullo_epi16(samples, gain);
+			__m128i hi = _mm_mulhi_epi16(samples, gain);
+
+			__m128i a = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 15);
+			__m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 15);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&p_samples[i]), _mm_packs_epi32(a, b));
+		}
+
+		for (int gain = Audio::ramp(from, to, i / GAIN_BLOCK, blocks); i < count; ++i) {
+			p_samples[i] = std::clamp((p_samples[i] * gain + (1 << 14)) >> 15, -32768, 32767);
+		}
+	}
+#endif
+
+#ifdef SIMD_NEON
+	static inline void scale_neon(Sint16 *p_samples, int count, int from, int to) {
+		int blocks = (count + GAIN_BLOCK - 1) / GAIN_BLOCK;
+		int i = 0;
+
+		// the saturating rounding doubling multiply high is exactly a rounded q15 multiply
+		for (; i + GAIN_BLOCK <= count; i += GAIN_BLOCK) {
+			int16x8_t gain = vdupq_n_s16(Audio::ramp(from, to, i / GAIN_BLOCK, blocks));
+
+			vst1q_s16(&p_samples[i], vqrdmulhq_s16(vld1q_s16(&p_samples[i]), gain));
+		}
+
+		for (int gain = Audio::ramp(from, to, i / GAIN_BLOCK, blocks); i < count; ++i) {
+			p_samples[i] = std::clamp((p_samples[i] * gain + (1 << 14)) >> 15, -32768, 32767);
+		}
+	}
+#endif
+
+	static inline void (*p_scale) (Sint16 *p_samples, int count, int from, int to) = Audio::scale;
+
+	static inline void unblock() {
+		if (Audio::blocked) {
+			Audio::blocked = false;
+			Audio::barrier.set_value();
+		}
+	}
+
+	~Audio() {
+		if (device_id != 0) {
+			SDL_CloseAudioDevice(device_id);
+		}
+	}
+};
+
+// draws straight from the raw capture, the fragment shader doing the unweave, crop, blur and brightness in a single pass
+class Shader {
+public:
+	GLuint m_program = 0;
+
+	Shader() {
+		if (!Shader::load()) {
+			printf("[%s] OpenGL functions unavailable.\n", NAME);
+			return;
+		}
+
+		GLuint vertex = this->compile(GL_VERTEX_SHADER, Shader::vertex);
+		GLuint fragment = this->compile(GL_FRAGMENT_SHADER, (std::string(Shader::defines()) + Shader::fragment).c_str());
+
+		if (vertex && fragment) {
+			this->link(vertex, fragment);
+		}
+
+		Shader::gl.DeleteShader(vertex);
+		Shader::gl.DeleteShader(fragment);
+
+		if (!this->m_program) {
+			return;
+		}
+
+		this->m_position = Shader::gl.GetAttribLocation(this->m_program, "a_position");
+		this->m_coord = Shader::gl.GetAttribLocation(this->m_program, "a_coord");
+		this->m_brightness = Shader::gl.GetUniformLocation(this->m_program, "u_brightness");
+		this->m_blur = Shader::gl.GetUniformLocation(this->m_program, "u_blur");
+
+		// the raw payload is 240 rgb pixels per row, so it goes up as is without any alignment padding
+		Shader::gl.GenTextures(1, &this->m_texture);
+		Shader::gl.BindTexture(GL_TEXTURE_2D, this->m_texture);
+		Shader::gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		Shader::gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		Shader::gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		Shader::gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		Shader::gl.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		Shader::gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGB, CAP_WIDTH, CAP_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	~Shader() {
+		if (this->m_texture) {
+			Shader::gl.DeleteTextures(1, &this->m_texture);
+		}
+
+		if (this->m_program) {
+			Shader::gl.DeleteProgram(this->m_program);
+		}
+	}
+
+	void upload(const UCHAR *p_buf, int first = 0, int last = CAP_HEIGHT) {
+		Shader::gl.BindTexture(GL_TEXTURE_2D, this->m_texture);
+		Shader::gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, first, CAP_WIDTH, last - first, GL_RGB, GL_UNSIGNED_BYTE, &p_buf[3 * CAP_WIDTH * first]);
+	}
+
+	void begin(int width, int height, int brightness, bool blur) {
+		Shader::gl.Viewport(0, 0, width, height);
+		Shader::gl.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		Shader::gl.Clear(GL_COLOR_BUFFER_BIT);
+
+		Shader::gl.UseProgram(this->m_program);
+		Shader::gl.BindTexture(GL_TEXTURE_2D, this->m_texture);
+
+		// matches the color mod the renderer path applies
+		Shader::gl.Uniform1f(this->m_brightness, static_cast<Uint8>(brightness * 2.55f) / 255.0f);
+		Shader::gl.Uniform1f(this->m_blur, blur);
+	}
+
+	// draws p_in_rect of the unwoven frame into p_out_rect of a width by height target, rotated clockwise around its center the way SDL_RenderCopyEx does
+	void draw(const SDL_Rect *p_in_rect, const SDL_Rect *p_out_rect, int angle, int width, int height) {
+		float c = std::cos(angle * M_PI / 180.0);
+		float s = std::sin(angle * M_PI / 180.0);
+
+		float cx = p_out_rect->x + p_out_rect->w / 2.0f;
+		float cy = p_out_rect->y + p_out_rect->h / 2.0f;
+
+		GLfloat positions[8];
+		GLfloat coords[8];
+
+		for (int i = 0; i < 4; ++i) {
+			float dx = (i & 1 ? 1 : -1) * p_out_rect->w / 2.0f;
+			float dy = (i & 2 ? 1 : -1) * p_out_rect->h / 2.0f;
+
+			positions[2 * i + 0] = (cx + dx * c - dy * s) / width * 2.0f - 1.0f;
+			positions[2 * i + 1] = 1.0f - (cy + dx * s + dy * c) / height * 2.0f;
+
+			coords[2 * i + 0] = p_in_rect->x + (i & 1 ? p_in_rect->w : 0);
+			coords[2 * i + 1] = p_in_rect->y + (i & 2 ? p_in_rect->h : 0);
+		}
+
+		Shader::gl.VertexAttribPointer(this->m_position, 2, GL_FLOAT, GL_FALSE, 0, positions);
+		Shader::gl.VertexAttribPointer(this->m_coord, 2, GL_FLOAT, GL_FALSE, 0, coords);
+		Shader::gl.EnableVertexAttribArray(this->m_position);
+		Shader::gl.EnableVertexAttribArray(this->m_coord);
+
+		Shader::gl.DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+private:
+	struct Functions {
+		decltype(&glBindTexture) BindTexture;
+		decltype(&glClear) Clear;
+		decltype(&glClearColor) ClearColor;
+		decltype(&glDeleteTextures) DeleteTextures;
+		decltype(&glDrawArrays) DrawArrays;
+		decltype(&glGenTextures) GenTextures;
+		decltype(&glPixelStorei) PixelStorei;
+		decltype(&glTexImage2D) TexImage2D;
+		decltype(&glTexParameteri) TexParameteri;
+		decltype(&glTexSubImage2D) TexSubImage2D;
+		decltype(&glViewport) Viewport;
+		PFNGLATTACHSHADERPROC AttachShader;
+		PFNGLCOMPILESHADERPROC CompileShader;
+		PFNGLCREATEPROGRAMPROC CreateProgram;
+		PFNGLCREATESHADERPROC CreateShader;
+		PFNGLDELETEPROGRAMPROC DeleteProgram;
+		PFNGLDELETESHADERPROC DeleteShader;
+		PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+		PFNGLGETATTRIBLOCATIONPROC GetAttribLocation;
+		PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog;
+		PFNGLGETPROGRAMIVPROC GetProgramiv;
+		PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+		PFNGLGETSHADERIVPROC GetShaderiv;
+		PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+		PFNGLLINKPROGRAMPROC LinkProgram;
+		PFNGLSHADERSOURCEPROC ShaderSource;
+		PFNGLUNIFORM1FPROC Uniform1f;
+		PFNGLUSEPROGRAMPROC UseProgram;
+		PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+	};
+
+	static inline Functions gl;
+
+	// no version directive so the same source builds as glsl 1.10 on desktop and glsl es 1.00 on kmsdrm
+	static inline const char *vertex =
+		"attribute vec2 a_position;\n"
+		"attribute vec2 a_coord;\n"
+		"varying vec2 v_coord;\n"
+		"void main() {\n"
+		"	v_coord = a_coord;\n"
+		"	gl_Position = vec4(a_position, 0.0, 1.0);\n"
+		"}\n";
+
+	// v_coord is in unwoven pixels, the capture keeping the rows only the top screen has first and then alternating bottom and top screen rows
+	static inline const char *fragment =
+		"uniform sampler2D u_capture;\n"
+		"uniform float u_brightness;\n"
+		"uniform float u_blur;\n"
+		"varying vec2 v_coord;\n"
+		"vec3 fetch(vec2 p) {\n"
+		"	p = clamp(p, vec2(0.0), vec2(CAP_WIDTH - 1.0, CAP_HEIGHT - 1.0));\n"
+		"	float row = p.y < DELTA_ROWS ? p.y : (p.y < TOP_ROWS ? 2.0 * (p.y - DELTA_ROWS) + DELTA_ROWS + 1.0 : 2.0 * (p.y - TOP_ROWS) + DELTA_ROWS);\n"
+		"	return texture2D(u_capture, vec2((p.x + 0.5) / CAP_WIDTH, (row + 0.5) / CAP_HEIGHT)).rgb;\n"
+		"}\n"
+		"void main() {\n"
+		"	vec3 color;\n"
+		"	if (u_blur > 0.5) {\n"
+		"		vec2 p = v_coord - 0.5;\n"
+		"		vec2 i = floor(p);\n"
+		"		vec2 f = p - i;\n"
+		"		color = mix(mix(fetch(i), fetch(i + vec2(1.0, 0.0)), f.x), mix(fetch(i + vec2(0.0, 1.0)), fetch(i + vec2(1.0, 1.0)), f.x), f.y);\n"
+		"	}\n"
+		"	else {\n"
+		"		color = fetch(floor(v_coord));\n"
+		"	}\n"
+		"	gl_FragColor = vec4(color * u_brightness, 1.0);\n"
+		"}\n";
+
+	GLuint m_texture = 0;
+
+	GLint m_position = -1;
+	GLint m_coord = -1;
+	GLint m_brightness = -1;
+	GLint m_blur = -1;
+
+	static inline std::string defines() {
+		return "#ifdef GL_FRAGMENT_PRECISION_HIGH\nprecision highp float;\n#elif defined(GL_ES)\nprecision mediump float;\n#endif\n"
+			"#define CAP_WIDTH " + std::to_string(CAP_WIDTH) + ".0\n"
+			"#define CAP_HEIGHT " + std::to_string(CAP_HEIGHT) + ".0\n"
+			"#define DELTA_ROWS " + std::to_string(DELTA_RES / CAP_WIDTH) + ".0\n"
+			"#define TOP_ROWS " + std::to_string(TOP_RES / CAP_WIDTH) + ".0\n";
+	}
+
+	static inline bool load() {
+		if (Shader::gl.VertexAttribPointer) {
+			return true;
+		}
+
+		Shader::gl.BindTexture = reinterpret_cast<decltype(&glBindTexture)>(SDL_GL_GetProcAddress("glBindTexture"));
+		Shader::gl.Clear = reinterpret_cast<decltype(&glClear)>(SDL_GL_GetProcAddress("glClear"));
+		Shader::gl.ClearColor = reinterpret_cast<decltype(&glClearColor)>(SDL_GL_GetProcAddress("glClearColor"));
+		Shader::gl.DeleteTextures = reinterpret_cast<decltype(&glDeleteTextures)>(SDL_GL_GetProcAddress("glDeleteTextures"));
+		Shader::gl.DrawArrays = reinterpret_cast<decltype(&glDrawArrays)>(SDL_GL_GetProcAddress("glDrawArrays"));
+		Shader::gl.GenTextures = reinterpret_cast<decltype(&glGenTextures)>(SDL_GL_GetProcAddress("glGenTextures"));
+		Shader::gl.PixelStorei = reinterpret_cast<decltype(&glPixelStorei)>(SDL_GL_GetProcAddress("glPixelStorei"));
+		Shader::gl.TexImage2D = reinterpret_cast<decltype(&glTexImage2D)>(SDL_GL_GetProcAddress("glTexImage2D"));
+		Shader::gl.TexParameteri = reinterpret_cast<decltype(&glTexParameteri)>(SDL_GL_GetProcAddress("glTexParameteri"));
+		Shader::gl.TexSubImage2D = reinterpret_cast<decltype(&glTexSubImage2D)>(SDL_GL_GetProcAddress("glTexSubImage2D"));
+		Shader::gl.Viewport = reinterpret_cast<decltype(&glViewport)>(SDL_GL_GetProcAddress("glViewport"));
+		Shader::gl.AttachShader = reinterpret_cast<PFNGLATTACHSHADERPROC>(SDL_GL_GetProcAddress("glAttachShader"));
+		Shader::gl.CompileShader = reinterpret_cast<PFNGLCOMPILESHADERPROC>(SDL_GL_GetProcAddress("glCompileShader"));
+		Shader::gl.CreateProgram = reinterpret_cast<PFNGLCREATEPROGRAMPROC>(SDL_GL_GetProcAddress("glCreateProgram"));
+		Shader::gl.CreateShader = reinterpret_cast<PFNGLCREATESHADERPROC>(SDL_GL_GetProcAddress("glCreateShader"));
+		Shader::gl.DeleteProgram = reinterpret_cast<PFNGLDELETEPROGRAMPROC>(SDL_GL_GetProcAddress("glDeleteProgram"));
+		Shader::gl.DeleteShader = reinterpret_cast<PFNGLDELETESHADERPROC>(SDL_GL_GetProcAddress("glDeleteShader"));
+		Shader::gl.EnableVertexAttribArray = reinterpret_cast<PFNGLENABLEVERTEXATTRIBARRAYPROC>(SDL_GL_GetProcAddress("glEnableVertexAttribArray"));
+		Shader::gl.GetAttribLocation = reinterpret_cast<PFNGLGETATTRIBLOCATIONPROC>(SDL_GL_GetProcAddress("glGetAttribLocation"));
+		Shader::gl.GetProgramInfoLog = reinterpret_cast<PFNGLGETPROGRAMINFOLOGPROC>(SDL_GL_GetProcAddress("glGetProgramInfoLog"));
+		Shader::gl.GetProgramiv = reinterpret_cast<PFNGLGETPROGRAMIVPROC>(SDL_GL_GetProcAddress("glGetProgramiv"));
+		Shader::gl.GetShaderInfoLog = reinterpret_cast<PFNGLGETSHADERINFOLOGPROC>(SDL_GL_GetProcAddress("glGetShaderInfoLog"));
+		Shader::gl.GetShaderiv = reinterpret_cast<PFNGLGETSHADERIVPROC>(SDL_GL_GetProcAddress("glGetShaderiv"));
+		Shader::gl.GetUniformLocation = reinterpret_cast<PFNGLGETUNIFORMLOCATIONPROC>(SDL_GL_GetProcAddress("glGetUniformLocation"));
+		Shader::gl.LinkProgram = reinterpret_cast<PFNGLLINKPROGRAMPROC>(SDL_GL_GetProcAddress("glLinkProgram"));
+		Shader::gl.ShaderSource = reinterpret_cast<PFNGLSHADERSOURCEPROC>(SDL_GL_GetProcAddress("glShaderSource"));
+		Shader::gl.Uniform1f = reinterpret_cast<PFNGLUNIFORM1FPROC>(SDL_GL_GetProcAddress("glUniform1f"));
+		Shader::gl.UseProgram = reinterpret_cast<PFNGLUSEPROGRAMPROC>(SDL_GL_GetProcAddress("glUseProgram"));
+		Shader::gl.VertexAttribPointer = reinterpret_cast<PFNGLVERTEXATTRIBPOINTERPROC>(SDL_GL_GetProcAddress("glVertexAttribPointer"));
+
+		return Shader::gl.ShaderSource && Shader::gl.UseProgram && Shader::gl.TexSubImage2D && Shader::gl.VertexAttribPointer;
+	}
+
+	GLuint compile(GLenum type, const char *p_source) {
+		GLuint shader = Shader::gl.CreateShader(type);
+		GLint status = GL_FALSE;
+
+		Shader::gl.ShaderSource(shader, 1, &p_source, nullptr);
+		Shader::gl.CompileShader(shader);
+		Shader::gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+		if (!status) {
+			char log[1024];
+
+			Shader::gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			printf("[%s] Shader compile failed: %s\n", NAME, log);
+
+			Shader::gl.DeleteShader(shader);
+			return 0;
+		}
+
+		return shader;
+	}
+
+	void link(GLuint vertex, GLuint fragment) {
+		GLint status = GL_FALSE;
+
+		this->m_program = Shader::gl.CreateProgram();
+
+		Shader::gl.AttachShader(this->m_program, vertex);
+		Shader::gl.AttachShader(this->m_program, fragment);
+		Shader::gl.LinkProgram(this->m_program);
+		Shader::gl.GetProgramiv(this->m_program, GL_LINK_STATUS, &status);
+
+		if (!status) {
+			char log[1024];
+
+			Shader::gl.GetProgramInfoLog(this->m_program, sizeof(log), nullptr, log);
+			printf("[%s] Shader link failed: %s\n", NAME, log);
+
+			Shader::gl.DeleteProgram(this->m_program);
+			this->m_program = 0;
+		}
+	}
+};
+
+// the rows of a screen that changed, both where they land in the unwoven frame and where they arrived in the raw capture
+struct Damage {
+	int first = CAP_HEIGHT;
+	int last = 0;
+	int raw_first = CAP_HEIGHT;
+	int raw_last = 0;
+
+	bool empty() const {
+		return this->first >= this->last;
+	}
+
+	void add(int raw, int row) {
+		this->first = std::min(this->first, row);
+		this->last = std::max(this->last, row + 1);
+		this->raw_first = std::min(this->raw_first, raw);
+		this->raw_last = std::max(this->raw_last, raw + 1);
+	}
+
+	void add(const Damage &damage) {
+		this->first = std::min(this->first, damage.first);
+		this->last = std::max(this->last, damage.last);
+		this->raw_first = std::min(this->raw_first, damage.raw_first);
+		this->raw_last = std::max(this->raw_last, damage.raw_last);
+	}
+};
+
+class Video {
+public:
+	class Screen {
+	public:
+		enum Type { TOP, BOT, JOINT, SIZE };
+		enum Crop { DEFAULT_3DS, SCALED_DS, NATIVE_DS, COUNT };
+		enum Fulltype { ONLY_TOP, ONLY_BOT, TOP_BOT_LT, TOP_BOT_RT, TOP_BOT_RB, TOP_BOT_LB, BOT_TOP_LT, BOT_TOP_RT, BOT_TOP_RB, BOT_TOP_LB, MODS };
+
+		static inline const int widths[Video::Screen::Crop::COUNT] = { 400, 320, 256 };
+		static inline const int heights[Video::Screen::Crop::COUNT] = { 240, 240, 192 };
+
+		SDL_Window *m_window;
+		SDL_Renderer *m_renderer;
+		SDL_Texture *m_in_texture;
+		SDL_Texture *m_out_texture;
+		// in opengl mode every window shares the one context and the one shader with its capture texture, these only pointing at them
+		SDL_GLContext m_context;
+		Shader *m_shader;
+		SDL_Rect m_in_rect;
+		SDL_Rect m_out_rect;
+
+		Fulltype m_fulltype = Video::Screen::Fulltype::ONLY_TOP;
+
+		// a stale texture no longer holds the last frame and has to be uploaded whole, and a window gets redrawn only when
+		// its rows changed or something happened to it
+		bool m_stale = true;
+		bool m_redraw = true;
+
+		bool m_blur = false;
+		Crop m_crop = Video::Screen::Crop::DEFAULT_3DS;
+		int m_rotation = 0;
+		double m_scale = 1.0;
+		int zindex = 0;
+
+		Screen() : m_window(nullptr), m_renderer(nullptr), m_in_texture(nullptr), m_out_texture(nullptr), m_context(nullptr), m_shader(nullptr) {}
+
+		std::string key() {
+			switch (this->m_type) {
+			case Video::Screen::Type::TOP:
+				return "top";
+
+			case Video::Screen::Type::BOT:
+				return "bot";
+
+			case Video::Screen::Type::JOINT:
+				return "joint";
+
+			default:
+				return "";
+			}
+		}
+
+		void build(Video::Screen::Type type, int u, int width, bool visible) {
+			this->m_type = type;
+
+			this->resize(this->width(Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS]), this->height(Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS]));
+
+			// Set up input rectangle (source texture coordinates)
+			this->m_in_rect.x = 0;
+			this->m_in_rect.y = u;
+			this->m_in_rect.w = this->m_height;
+			this->m_in_rect.h = width;
+
+			// Set up output rectangle (destination on screen)
+			this->m_out_rect.x = (width - this->m_height) / 2;
+			this->m_out_rect.y = (this->m_height - width) / 2;
+			this->m_out_rect.w = this->m_height;
+			this->m_out_rect.h = width;
+			
+			if (visible) {
+				this->open();
+			}
+		}
+
+		void reset() {
+			this->m_stale = true;
+
+			if(g_kmsdrm){
+				if(this->m_type == Video::Screen::Type::TOP || this->m_type == Video::Screen::Type::JOINT){
+					this->resize(g_display_bounds[0].w, g_display_bounds[0].h);
+				}else{
+					this->resize(g_display_bounds[1].w, g_display_bounds[1].h);	
+				}
+			}else{
+				this->resize(this->width(Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS]), this->height(Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS]));
+			}
+
+			if (this->m_in_texture) {
+				SDL_DestroyTexture(this->m_in_texture);
+				this->m_in_texture = nullptr;
+			}
+
+			this->target();
+
+			if (this->m_rotation) {
+				if (this->horizontal()) {
+					std::swap(this->m_width, this->m_height);
+				}
+
+				this->rotate();
+			}
+
+			if (this->m_crop) {
+				this->crop();
+			}
+
+			this->move();
+			this->fit();
+		}
+
+		// the capture texture only holds the rows this window can show, and follows them whenever the crop or the layout changes
+		void fit() {
+			int first, last;
+			this->region(&first, &last);
+
+			if (first == this->m_first && last == this->m_last && (this->m_in_texture || !this->m_renderer)) {
+				return;
+			}
+
+			this->m_first = first;
+			this->m_last = last;
+			this->m_stale = true;
+
+			if (!this->m_renderer) {
+				return;
+			}
+
+			if (this->m_in_texture) {
+				SDL_DestroyTexture(this->m_in_texture);
+			}
+
+			this->m_in_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32,
+													SDL_TEXTUREACCESS_STREAMING, CAP_WIDTH, last - first);
+			if (!this->m_in_texture) {
+				printf("[%s] SDL_CreateTexture (input) failed: %s\n", NAME, SDL_GetError());
+			}
+		}
+
+		// unwoven rows the capture texture starts and ends at, every crop showing all 240 columns of them
+		int m_first = 0;
+		int m_last = CAP_HEIGHT;
+
+		void blur() {
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, (this->m_blur)?"1":"0");
+		}
+
+		// the render target is only kept while blurring, everything else being drawn in a single pass
+		void target() {
+			if (this->m_out_texture) {
+				SDL_DestroyTexture(this->m_out_texture);
+				this->m_out_texture = nullptr;
+			}
+
+			if (!this->m_renderer || !this->m_blur) {
+				return;
+			}
+
+			this->m_out_texture = SDL_CreateTexture(this->m_renderer, SDL_PIXELFORMAT_RGBA32, 
+													SDL_TEXTUREACCESS_TARGET, this->m_width, this->m_height);
+			if (!this->m_out_texture) {
+				printf("[%s] SDL_CreateTexture (output) failed: %s\n", NAME, SDL_GetError());
+			}
+		}
+
+		// the rects all come out of the layout worked out up front, outside split mode the top and bottom screens following
+		// the joint window's crop and rotation
+		void move() {
+			Video::Screen *p_from = (Video::split || this->m_type == Video::Screen::Type::JOINT) ? this : &Video::screens[Video::Screen::Type::JOINT];
+			const Video::Layout::Rects &rects = Video::Layout::find(this->m_type, p_from->m_crop, p_from->m_rotation, this->m_fulltype, this->m_width, this->m_height);
+
+			switch (this->m_type) {
+			case Video::Screen::Type::TOP:
+				this->m_in_rect = rects.top_in;
+				this->m_out_rect = rects.top_out;
+				return;
+
+			case Video::Screen::Type::BOT:
+				this->m_in_rect = rects.bot_in;
+				this->m_out_rect = rects.bot_out;
+				return;
+
+			case Video::Screen::Type::JOINT:
+				Video::screens[Video::Screen::Type::TOP].m_in_rect = rects.top_in;
+				Video::screens[Video::Screen::Type::TOP].m_out_rect = rects.top_out;
+				Video::screens[Video::Screen::Type::BOT].m_in_rect = rects.bot_in;
+				Video::screens[Video::Screen::Type::BOT].m_out_rect = rects.bot_out;
+
+				Video::screens[Video::Screen::Type::TOP].zindex = rects.top_zindex;
+				Video::screens[Video::Screen::Type::BOT].zindex = rects.bot_zindex;
+				return;
+
+			case Video::Screen::Type::SIZE:
+				// This shouldn't happen in normal operation
+				return;
+			}
+		}
+
+		void toggle() {
+			this->m_window ? this->close() : this->open();
+		}
+
+		void close() {
+			if (this->m_in_texture) {
+				SDL_DestroyTexture(this->m_in_texture);
+				this->m_in_texture = nullptr;
+			}
+			if (this->m_out_texture) {
+				SDL_DestroyTexture(this->m_out_texture);
+				this->m_out_texture = nullptr;
+			}
+			if (this->m_renderer) {
+				SDL_DestroyRenderer(this->m_renderer);
+				this->m_renderer = nullptr;
+			}
+			if (this->m_context && !--Video::Screen::windows) {
+				SDL_GL_MakeCurrent(this->m_window, this->m_context);
+				delete Video::Screen::p_shader;
+				Video::Screen::p_shader = nullptr;
+				SDL_GL_DeleteContext(Video::Screen::context);
+				Video::Screen::context = nullptr;
+			}
+			this->m_context = nullptr;
+			this->m_shader = nullptr;
+			if (this->m_window) {
+				SDL_DestroyWindow(this->m_window);
+				this->m_window = nullptr;
+			}
+			this->m_applied_width = 0;
+			this->m_applied_height = 0;
+		}
+
+		void draw() {
+			if (!this->m_window || !(this->m_renderer || this->m_context)) return;
+			if (!g_kmsdrm) {
+				this->apply();
+			}
+
+			if (this->m_context) {
+				this->shade(&this->m_in_rect, &this->m_out_rect, nullptr, nullptr);
+				return;
+			}
+
+			this->copy(&this->m_in_rect, &this->m_out_rect, nullptr, nullptr);
+		}
+
+		void draw(SDL_Rect *p_top_rect, SDL_Rect *p_top_out_rect, SDL_Rect *p_bot_rect, SDL_Rect *p_bot_out_rect) {
+			if (!this->m_window || !(this->m_renderer || this->m_context)) return;
+			if (!g_kmsdrm) {
+				this->apply();
+			}
+
+			if (this->m_context) {
+				if(Video::screens[Video::Screen::Type::BOT].zindex > Video::screens[Video::Screen::Type::TOP].zindex) {
+					this->shade(p_top_rect, p_top_out_rect, p_bot_rect, p_bot_out_rect);
+				}else{
+					this->shade(p_bot_rect, p_bot_out_rect, p_top_rect, p_top_out_rect);
+				}
+				return;
+			}
+
+			if(Video::screens[Video::Screen::Type::BOT].zindex > Video::screens[Video::Screen::Type::TOP].zindex) {
+				this->copy(p_top_rect, p_top_out_rect, p_bot_rect, p_bot_out_rect);
+			}else{
+				this->copy(p_bot_rect, p_bot_out_rect, p_top_rect, p_top_out_rect);
+			}
+		}
+
+		// the raw capture goes up as is, a quarter smaller than the unwoven frame, only from the first to the last raw row that changed,
+		// and into the texture every window shares
+		void upload(const UCHAR *p_buf, int first = 0, int last = CAP_HEIGHT) {
+			if (!this->m_shader) return;
+
+			SDL_GL_MakeCurrent(this->m_window, this->m_context);
+			this->m_shader->upload(p_buf, first, last);
+		}
+
+		int m_width = 0;
+		int m_height = 0;
+
+		void rotateLeft() {
+			if (g_kmsdrm) {
+				return;
+			}
+
+			this->m_rotation = ((this->m_rotation / 90 * 90 - 90) % 360 + 360) % 360;
+			this->rotate();
+		}
+
+		void rotateRight() {
+			if (g_kmsdrm) {
+				return;
+			}
+
+			this->m_rotation = ((this->m_rotation / 90 * 90 - 90) % 360 + 360) % 360;
+			this->rotate();
+		}
+
+		void rotate() {
+			this->apply();
+
+			this->target();
+		}
+
+		void crop() {
+			if (g_kmsdrm) {
+				return;
+			}
+
+			this->horizontal() ? this->resize(this->height(Video::Screen::heights[this->m_crop]), this->width(Video::Screen::widths[this->m_crop])) : this->resize(this->width(Video::Screen::widths[this->m_crop]), this->height(Video::Screen::heights[this->m_crop]));
+
+			this->apply();
+
+			this->target();
+		}
+
+		// resizing a window is a round trip to the compositor, so it only happens when the size the window should have changed
+		void apply() {
+			int width = this->m_width * this->m_scale;
+			int height = this->m_height * this->m_scale;
+
+			if (!this->m_window || (width == this->m_applied_width && height == this->m_applied_height)) {
+				return;
+			}
+
+			SDL_SetWindowSize(this->m_window, width, height);
+
+			this->m_applied_width = width;
+			this->m_applied_height = height;
+		}
+
+		// a window resized to anything but its size gets it back on the next draw
+		void resized(int width, int height) {
+			if (width != this->m_applied_width || height != this->m_applied_height) {
+				this->m_applied_width = 0;
+				this->m_applied_height = 0;
+			}
+		}
+
+	private:
+		Screen::Type m_type;
+
+		int m_applied_width = 0;
+		int m_applied_height = 0;
+
+		static inline SDL_GLContext context = nullptr;
+		static inline Shader *p_shader = nullptr;
+		static inline int windows = 0;
+
+		bool horizontal() {
+			return this->m_rotation / 10 % 2;
+		}
+
+		int height(int height) {
+			return height * (this->m_type == Video::Screen::Type::JOINT ? 2 : 1);
+		}
+
+		int width(int width) {
+			return (this->m_type == Video::Screen::Type::BOT && width == this->widths[Video::Screen::Crop::DEFAULT_3DS]) ? this->widths[Video::Screen::Crop::SCALED_DS] : width;
+		}
+
+		std::string title() {
+			switch (this->m_type) {
+			case Video::Screen::Type::TOP:
+				return std::string(NAME) + "-top";
+
+			case Video::Screen::Type::BOT:
+				return std::string(NAME) + "-bot";
+
+			default:
+				return NAME;
+			}
+		}
+
+		void resize(int width, int height) {
+			this->m_width = width;
+			this->m_height = height;
+		}
+
+		// the joint window shows the rows of both screens, which are the only ones cropping ever changes
+		void region(int *p_first, int *p_last) {
+			const SDL_Rect *p_top_rect = &Video::screens[Video::Screen::Type::TOP].m_in_rect;
+			const SDL_Rect *p_bot_rect = &Video::screens[Video::Screen::Type::BOT].m_in_rect;
+
+			switch (this->m_type) {
+			case Video::Screen::Type::JOINT:
+				*p_first = std::min(p_top_rect->y, p_bot_rect->y);
+				*p_last = std::max(p_top_rect->y + p_top_rect->h, p_bot_rect->y + p_bot_rect->h);
+				break;
+
+			default:
+				*p_first = this->m_in_rect.y;
+				*p_last = this->m_in_rect.y + this->m_in_rect.h;
+				break;
+			}
+
+			*p_first = std::max(0, std::min(CAP_HEIGHT - 1, *p_first));
+			*p_last = std::max(*p_first + 1, std::min(CAP_HEIGHT, *p_last));
+		}
+
+		// source rects are in unwoven frame rows, the capture texture starting at the first row it holds
+		SDL_Rect source(const SDL_Rect *p_rect) {
+			return { p_rect->x, p_rect->y - this->m_first, p_rect->w, p_rect->h };
+		}
+
+		// without blur the capture is drawn straight to the window in one pass, the layout being scaled up to the window's size, while
+		// blurring goes through the render target so the capture is only smoothed once it's been rotated and cropped at its own size
+		void copy(SDL_Rect *p_first_rect, SDL_Rect *p_first_out_rect, SDL_Rect *p_second_rect, SDL_Rect *p_second_out_rect) {
+			Uint8 brightness = static_cast<Uint8>(Video::brightness * 2.55f);
+
+			SDL_SetRenderTarget(this->m_renderer, this->m_out_texture);
+			SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
+			SDL_RenderClear(this->m_renderer);
+
+			if (this->m_out_texture) {
+				SDL_RenderSetScale(this->m_renderer, 1.0f, 1.0f);
+			}
+
+			else {
+				int width, height;
+
+				SDL_GetRendererOutputSize(this->m_renderer, &width, &height);
+				SDL_RenderSetScale(this->m_renderer, static_cast<float>(width) / this->m_width, static_cast<float>(height) / this->m_height);
+			}
+
+			if (this->m_in_texture) {
+				SDL_Rect first_rect = this->source(p_first_rect);
+
+				if (this->m_out_texture) {
+					SDL_SetTextureColorMod(this->m_in_texture, 255, 255, 255);
+				}
+
+				else {
+					SDL_SetTextureColorMod(this->m_in_texture, brightness, brightness, brightness);
+				}
+
+				SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, &first_rect, p_first_out_rect, 
+					this->m_rotation - 90, NULL, SDL_FLIP_NONE);
+
+				if (p_second_rect) {
+					SDL_Rect second_rect = this->source(p_second_rect);
+
+					SDL_RenderCopyEx(this->m_renderer, this->m_in_texture, &second_rect, p_second_out_rect, 
+						this->m_rotation - 90, NULL, SDL_FLIP_NONE);
+				}
+			}
+
+			if (this->m_out_texture) {
+				// Reset render target to window
+				SDL_SetRenderTarget(this->m_renderer, nullptr);
+				SDL_RenderSetScale(this->m_renderer, 1.0f, 1.0f);
+				SDL_SetRenderDrawColor(this->m_renderer, 0, 0, 0, 255);
+				SDL_RenderClear(this->m_renderer);
+
+				// Apply brightness by modulating texture color
+				SDL_SetTextureColorMod(this->m_out_texture, brightness, brightness, brightness);
+				SDL_RenderCopy(this->m_renderer, this->m_out_texture, nullptr, nullptr);
+			}
+
+			SDL_RenderPresent(this->m_renderer);
+		}
+
+		void shade(SDL_Rect *p_first_rect, SDL_Rect *p_first_out_rect, SDL_Rect *p_second_rect, SDL_Rect *p_second_out_rect) {
+			if (!this->m_shader) return;
+
+			int width, height;
+
+			SDL_GL_MakeCurrent(this->m_window, this->m_context);
+			SDL_GL_GetDrawableSize(this->m_window, &width, &height);
+
+			this->m_shader->begin(width, height, Video::brightness, this->m_blur);
+			this->m_shader->draw(p_first_rect, p_first_out_rect, this->m_rotation - 90, this->m_width, this->m_height);
+
+			if (p_second_rect) {
+				this->m_shader->draw(p_second_rect, p_second_out_rect, this->m_rotation - 90, this->m_width, this->m_height);
+			}
+
+			SDL_GL_SwapWindow(this->m_window);
+		}
+
+		void open() {
+			this->m_stale = true;
+
+			this->blur();
+			if(g_kmsdrm){
+				int numScreen = (this->m_type == Video::Screen::Type::JOINT)?0:this->m_type;
+
+				this->m_window = SDL_CreateWindow(this->title().c_str(), 
+											g_display_bounds[numScreen].x, g_display_bounds[numScreen].y, 
+											g_display_bounds[numScreen].w, g_display_bounds[numScreen].h, 
+											SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | (Video::opengl ? SDL_WINDOW_OPENGL : 0));
+			}else{
+				this->m_window = SDL_CreateWindow(this->title().c_str(), 
+											SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
+											this->m_width * this->m_scale, this->m_height * this->m_scale, 
+											SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | (Video::opengl ? SDL_WINDOW_OPENGL : 0));
+			}
+
+			if (!this->m_window) {
+				printf("[%s] SDL_CreateWindow failed: %s\n", NAME, SDL_GetError());
+				return;
+			}
+
+			SDL_GetWindowSize(this->m_window, &this->m_applied_width, &this->m_applied_height);
+
+			// the first window creates the shared context, any other one just draws with it
+			if (Video::opengl) {
+				if (!Video::Screen::context) {
+					Video::Screen::context = SDL_GL_CreateContext(this->m_window);
+
+					if (!Video::Screen::context) {
+						printf("[%s] SDL_GL_CreateContext failed: %s\n", NAME, SDL_GetError());
+						SDL_DestroyWindow(this->m_window);
+						this->m_window = nullptr;
+						return;
+					}
+
+					Video::Screen::p_shader = new Shader();
+
+					if (!Video::Screen::p_shader->m_program) {
+						delete Video::Screen::p_shader;
+						Video::Screen::p_shader = nullptr;
+					}
+				}
+
+				this->m_context = Video::Screen::context;
+				this->m_shader = Video::Screen::p_shader;
+
+				++Video::Screen::windows;
+
+				SDL_GL_MakeCurrent(this->m_window, this->m_context);
+				SDL_GL_SetSwapInterval(Video::vsync ? 1 : 0);
+
+				return;
+			}
+
+			this->m_renderer = SDL_CreateRenderer(this->m_window, -1, 
+				Video::vsync ? SDL_RENDERER_PRESENTVSYNC : SDL_RENDERER_ACCELERATED);
+
+			if (!this->m_renderer) {
+				printf("[%s] SDL_CreateRenderer failed: %s\n", NAME, SDL_GetError());
+				SDL_DestroyWindow(this->m_window);
+				this->m_window = nullptr;
+				return;
+			}
+
+			// Create input texture for capture data
+			this->fit();
+
+			// Create output texture
+			this->target();
+		}
+
+
+	};
+
+	// every set of rects the screens can be laid out with, one per type, crop, rotation, fulltype and display size, worked out
+	// once up front so moving a screen is a lookup
+	class Layout {
+	public:
+		struct Rects {
+			SDL_Rect top_in;
+			SDL_Rect top_out;
+			SDL_Rect bot_in;
+			SDL_Rect bot_out;
+			int top_zindex;
+			int bot_zindex;
+		};
+
+		// the fulltype and the display size only matter on kmsdrm, and every other key has them as 0
+		static inline const Rects &find(int type, int crop, int rotation, int fulltype, int width, int height) {
+			if (!g_kmsdrm) {
+				fulltype = width = height = 0;
+			}
+
+			Key key{ type, crop, rotation, fulltype, width, height };
+
+			auto it = Video::Layout::rects.find(key);
+			if (it == Video::Layout::rects.end()) {
+				it = Video::Layout::rects.emplace(key, Video::Layout::compute(type, crop, rotation, fulltype, width, height)).first;
+			}
+
+			return it->second;
+		}
+
+		// each screen on kmsdrm fills its display, in either orientation, the joint one sharing the top screen's display
+		static inline void build() {
+			Video::Layout::rects.clear();
+
+			for (int type = Video::Screen::Type::TOP; type < Video::Screen::Type::SIZE; ++type) {
+				SDL_Rect bounds = g_display_bounds[type == Video::Screen::Type::BOT ? 1 : 0];
+
+				for (int crop = Video::Screen::Crop::DEFAULT_3DS; crop < Video::Screen::Crop::COUNT; ++crop) {
+					for (int rotation = 0; rotation < 360; rotation += 90) {
+						for (int fulltype = Video::Screen::Fulltype::ONLY_TOP; fulltype < Video::Screen::Fulltype::MODS; ++fulltype) {
+							Video::Layout::find(type, crop, rotation, fulltype, bounds.w, bounds.h);
+							Video::Layout::find(type, crop, rotation, fulltype, bounds.h, bounds.w);
+						}
+					}
+				}
+			}
+		}
+
+	private:
+		using Key = std::tuple<int, int, int, int, int, int>;
+
+		static inline std::map<Key, Rects> rects;
+
+		// a screen standing up is centred on its own turned around size, and on kmsdrm it fills the display
+		static inline SDL_Rect place(int w, int h, bool horizontal, int width, int height) {
+			if (g_kmsdrm) {
+				return { (width - height) / 2, (height - width) / 2, height, width };
+			}
+
+			if (horizontal) {
+				return { 0, 0, w, h };
+			}
+
+			return { (h - w) / 2, (w - h) / 2, w, h };
+		}
+
+		static inline Rects compute(int type, int crop, int rotation, int fulltype, int width, int height) {
+			Rects rects = {};
+			bool horizontal = rotation / 10 % 2;
+
+			// the cropped top screen starts 40 rows in, and the bottom one is always its 320 rows
+			int top_y = crop ? (Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS] - Video::Screen::widths[Video::Screen::Crop::SCALED_DS]) / 2 : 0;
+
+			rects.top_in = { 0, top_y, Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS], top_y ? Video::Screen::widths[Video::Screen::Crop::SCALED_DS] : Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS] };
+			rects.bot_in = { 0, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], Video::Screen::heights[Video::Screen::Crop::DEFAULT_3DS], Video::Screen::widths[Video::Screen::Crop::SCALED_DS] };
+
+			rects.top_out = Video::Layout::place(Video::Screen::heights[crop], Video::Screen::widths[crop], horizontal, width, height);
+			rects.bot_out = Video::Layout::place(Video::Screen::heights[crop], crop == Video::Screen::Crop::DEFAULT_3DS ? Video::Screen::widths[Video::Screen::Crop::SCALED_DS] : Video::Screen::widths[crop], horizontal, width, height);
+
+			if (type != Video::Screen::Type::JOINT) {
+				return rects;
+			}
+
+			SDL_Rect *top_screen = &rects.top_out;
+			SDL_Rect *bottom_screen = &rects.bot_out;
+
+			if (g_kmsdrm) {
+				switch (fulltype) {
+				case Video::Screen::Fulltype::ONLY_TOP:
+					bottom_screen->w = 0;
+					bottom_screen->h = 0;
+					break;
+
+				case Video::Screen::Fulltype::ONLY_BOT:
+					top_screen->w = 0;
+					top_screen->h = 0;
+					break;
+
+				case Video::Screen::Fulltype::MODS:
+					// This shouldn't happen in normal operation
+					break;
+
+				default:
+				{
+					// the picture in picture screen is a quarter of the display, in one of its corners and drawn over the other one
+					bool right = fulltype == Video::Screen::Fulltype::TOP_BOT_RT || fulltype == Video::Screen::Fulltype::TOP_BOT_RB || fulltype == Video::Screen::Fulltype::BOT_TOP_RT || fulltype == Video::Screen::Fulltype::BOT_TOP_RB;
+					bool bottom = fulltype == Video::Screen::Fulltype::TOP_BOT_LB || fulltype == Video::Screen::Fulltype::TOP_BOT_RB || fulltype == Video::Screen::Fulltype::BOT_TOP_LB || fulltype == Video::Screen::Fulltype::BOT_TOP_RB;
+					bool bot_on_top = fulltype < Video::Screen::Fulltype::BOT_TOP_LT;
+
+					int x = (width / 4 - height / 4) / 2;
+					int y = (height / 4 - width / 4) / 2;
+
+					SDL_Rect corner = { right ? width - height / 4 - x : x, bottom ? height - width / 4 - y : y, height / 4, width / 4 };
+
+					if (bot_on_top) {
+						*bottom_screen = corner;
+						rects.bot_zindex = 1;
+					}
+					else {
+						*top_screen = corner;
+						rects.top_zindex = 1;
+					}
+					break;
+				}
+				}
+
+				return rects;
+			}
+
+			switch (rotation) {
+			case 0:
+			{
+				int bot_diff = (bottom_screen->h - bottom_screen->w) / 2;
+				bottom_screen->x = (top_screen->h - bottom_screen->h) / 2 + bot_diff;
+				bottom_screen->y += top_screen->w;
+				break;
+			}
+			case 90:
+			{
+				bottom_screen->y = (top_screen->h - bottom_screen->h) / 2;
+				top_screen->x += bottom_screen->w;
+				break;
+			}
+			case 180:
+			{
+				int bot_diff = (bottom_screen->h - bottom_screen->w) / 2;
+				bottom_screen->x = (top_screen->h - bottom_screen->h) / 2 + bot_diff;
+				top_screen->y += bottom_screen->w;
+				break;
+			}
+			case 270:
+			{
+				bottom_screen->y = (top_screen->h - bottom_screen->h) / 2;
+				bottom_screen->x += top_screen->w;
+				break;
+			}
+			}
+
+			return rects;
+		}
+	};
+
+	// grabs frames as png screenshots, the render thread only ever copying a transfer into a free slot of a fixed pool and a pool
+	// of workers unweaving, turning upright, compressing and writing them, a frame finding no free slot being skipped rather
+	// than waited for
+	class Screenshot {
+	public:
+		// what a screen shows, taken from its window when the screenshot is asked for
+		struct View {
+			Video::Layout::Rects rects;
+			int type;
+			int angle;
+			int width;
+			int height;
+		};
+
+		static inline int burst = SCREENSHOT_BURST;
+
+		static inline void start() {
+			int workers = std::max(1, std::min<int>(SCREENSHOT_WORKERS, std::thread::hardware_concurrency() / 2));
+
+			for (int i = 0; i < workers; ++i) {
+				Video::Screenshot::workers.emplace_back(Video::Screenshot::work);
+			}
+		}
+
+		// whatever was grabbed still gets written
+		static inline void stop() {
+			Video::Screenshot::stopping = true;
+
+			for (size_t i = 0; i < Video::Screenshot::workers.size(); ++i) {
+				SDL_SemPost(Video::Screenshot::semaphore);
+			}
+
+			for (std::thread &worker : Video::Screenshot::workers) {
+				worker.join();
+			}
+
+			Video::Screenshot::workers.clear();
+		}
+
+		// count frames of a screen, or of both as laid out in the joint window, starting with the next one rendered, each
+		// cropped, turned and sized the way the window shows it right now
+		static inline void request(int count, int type) {
+			if (Video::Screenshot::pending) {
+				return;
+			}
+
+			std::string path = CONF_DIR + "screenshots/";
+
+			char name[64];
+			time_t now = time(nullptr);
+			strftime(name, sizeof(name), "%Y%m%d-%H%M%S", localtime(&now));
+
+			// screenshots taken within the same second keep counting up instead of overwriting each other
+			if (Video::Screenshot::prefix != path + NAME + "-" + name + "-") {
+				Video::Screenshot::prefix = path + NAME + "-" + name + "-";
+				Video::Screenshot::taken = 0;
+			}
+
+			Video::Screen *p_screen = &Video::screens[type];
+			Video::Screen *p_from = (Video::split || type == Video::Screen::Type::JOINT) ? p_screen : &Video::screens[Video::Screen::Type::JOINT];
+
+			Video::Screenshot::view = { Video::Layout::find(type, p_from->m_crop, p_from->m_rotation, p_screen->m_fulltype, p_screen->m_width, p_screen->m_height),
+				type, p_from->m_rotation - 90, p_screen->m_width, p_screen->m_height };
+			Video::Screenshot::pending = count;
+
+			printf("[%s] Taking %d screenshot%s in \"%s\".\n", NAME, count, count == 1 ? "" : "s", path.c_str());
+		}
+
+		// the screens go where the layout puts them, on black like the window clears to, the one drawn over the other last
+		static inline void compose(const UCHAR *p_rgba, UCHAR *p_image, const View &view) {
+			memset(p_image, 0, view.width * view.height * 3);
+
+			bool top = view.type != Video::Screen::Type::BOT;
+			bool bot = view.type != Video::Screen::Type::TOP;
+			bool over = view.rects.top_zindex > view.rects.bot_zindex;
+
+			if (bot && over) {
+				Video::Screenshot::draw(p_rgba, view.rects.bot_in, view.rects.bot_out, view.angle, p_image, view.width, view.height);
+			}
+
+			if (top) {
+				Video::Screenshot::draw(p_rgba, view.rects.top_in, view.rects.top_out, view.angle, p_image, view.width, view.height);
+			}
+
+			if (bot && !over) {
+				Video::Screenshot::draw(p_rgba, view.rects.bot_in, view.rects.bot_out, view.angle, p_image, view.width, view.height);
+			}
+		}
+
+		// the slot the transfer was copied into, or -1 when none is wanted or none is free
+		static inline int grab(const UCHAR *p_buf) {
+			if (!Video::Screenshot::pending) {
+				return -1;
+			}
+
+			for (int i = 0; i < SCREENSHOT_SLOTS; ++i) {
+				int state = Video::Screenshot::FREE;
+
+				if (Video::Screenshot::states[i].compare_exchange_strong(state, Video::Screenshot::FILLING)) {
+					memcpy(Video::Screenshot::bufs[i], p_buf, FRAME_SIZE_RGB);
+					return i;
+				}
+			}
+
+			--Video::Screenshot::pending;
+			printf("[%s] Screenshot %d skipped, the encoders are behind.\n", NAME, Video::Screenshot::taken++);
+
+			return -1;
+		}
+
+		// a copy made while the slot was being refilled is thrown away, and the next frame is taken instead
+		static inline void submit(int slot, bool valid) {
+			if (slot < 0) {
+				return;
+			}
+
+			if (!valid) {
+				Video::Screenshot::states[slot].store(Video::Screenshot::FREE);
+				return;
+			}
+
+			char number[16];
+			snprintf(number, sizeof(number), "%03d", Video::Screenshot::taken++);
+
+			Video::Screenshot::paths[slot] = Video::Screenshot::prefix + number + ".png";
+			Video::Screenshot::views[slot] = Video::Screenshot::view;
+			--Video::Screenshot::pending;
+
+			Video::Screenshot::states[slot].store(Video::Screenshot::QUEUED);
+			SDL_SemPost(Video::Screenshot::semaphore);
+		}
+
+	private:
+		enum State { FREE, FILLING, QUEUED, ENCODING };
+
+		static inline UCHAR bufs[SCREENSHOT_SLOTS][FRAME_SIZE_RGB];
+		static inline std::atomic<int> states[SCREENSHOT_SLOTS];
+		static inline std::string paths[SCREENSHOT_SLOTS];
+		static inline View views[SCREENSHOT_SLOTS];
+
+		// only the render thread touches the request
+		static inline int pending = 0;
+		static inline int taken = 0;
+		static inline View view;
+		static inline std::string prefix;
+
+		static inline SDL_sem *semaphore = SDL_CreateSemaphore(0);
+		static inline std::vector<std::thread> workers;
+		static inline std::atomic<bool> stopping{false};
+
+		static inline void work() {
+			std::vector<UCHAR> rgba(FRAME_SIZE_RGBA);
+			std::vector<UCHAR> image;
+
+			while (true) {
+				SDL_SemWait(Video::Screenshot::semaphore);
+
+				int slot = -1;
+
+				for (int i = 0; i < SCREENSHOT_SLOTS && slot < 0; ++i) {
+					int state = Video::Screenshot::QUEUED;
+
+					if (Video::Screenshot::states[i].compare_exchange_strong(state, Video::Screenshot::ENCODING)) {
+						slot = i;
+					}
+				}
+
+				if (slot < 0) {
+					if (Video::Screenshot::stopping) {
+						return;
+					}
+
+					continue;
+				}
+
+				std::error_code error;
+				std::filesystem::create_directories(std::filesystem::path(Video::Screenshot::paths[slot]).parent_path(), error);
+
+				Video::map(Video::Screenshot::bufs[slot], rgba.data());
+				Video::Screenshot::encode(rgba.data(), image, Video::Screenshot::views[slot], Video::Screenshot::paths[slot]);
+
+				Video::Screenshot::states[slot].store(Video::Screenshot::FREE);
+			}
+		}
+
+		static inline void encode(const UCHAR *p_rgba, std::vector<UCHAR> &image, const View &view, const std::string &path) {
+			image.resize(view.width * view.height * 3);
+			Video::Screenshot::compose(p_rgba, image.data(), view);
+
+			unsigned error = lodepng_encode24_file(path.c_str(), image.data(), view.width, view.height);
+
+			if (error) {
+				printf("[%s] Screenshot \"%s\" save failed: %s\n", NAME, path.c_str(), lodepng_error_text(error));
+			}
+		}
+
+		// the software counterpart of Shader::draw, every pixel of the image inside the turned out rect taking the nearest
+		// pixel of the in rect like SDL_RenderCopyEx does without blur, in doubled coordinates so every centre is whole
+		static inline void draw(const UCHAR *p_rgba, const SDL_Rect &in, const SDL_Rect &out, int angle, UCHAR *p_image, int width, int height) {
+			int turn = (angle % 360 + 360) % 360;
+			int c = turn == 0 ? 1 : turn == 180 ? -1 : 0;
+			int s = turn == 90 ? 1 : turn == 270 ? -1 : 0;
+
+			if (out.w <= 0 || out.h <= 0) {
+				return;
+			}
+
+			std::vector<int> columns(2 * out.w);
+			std::vector<int> rows(2 * out.h);
+
+			for (int u = 0; u < 2 * out.w; ++u) {
+				columns[u] = in.x + u * in.w / (2 * out.w);
+			}
+
+			for (int v = 0; v < 2 * out.h; ++v) {
+				rows[v] = in.y + v * in.h / (2 * out.h);
+			}
+
+			for (int y = 0; y < height; ++y) {
+				int q = 2 * y + 1 - 2 * out.y - out.h;
+				UCHAR *p_out = &p_image[3 * width * y];
+
+				for (int x = 0; x < width; ++x, p_out += 3) {
+					int p = 2 * x + 1 - 2 * out.x - out.w;
+					int u = c * p + s * q + out.w;
+					int v = c * q - s * p + out.h;
+
+					if (u < 0 || u >= 2 * out.w || v < 0 || v >= 2 * out.h) {
+						continue;
+					}
+
+					const UCHAR *p_in = &p_rgba[4 * (CAP_WIDTH * rows[v] + columns[u])];
+
+					p_out[0] = p_in[0];
+					p_out[1] = p_in[1];
+					p_out[2] = p_in[2];
+				}
+			}
+		}
+	};
+
+	static inline Screen screens[Video::Screen::Type::SIZE];
+
+	static inline int brightness = 100;
+
+	static inline bool split = false;
+	static inline bool vsync = false;
+	static inline bool opengl = false;
+
+	static inline Mailbox mailbox{Mailbox::Policy::LATEST};
+
+	static inline void (*p_load) (std::string path, std::string name);
+	static inline void (*p_save) (std::string path, std::string name);
+
+	static inline Screen *screen(std::string key) {
+		if (key == "top") {
+			return &Video::screens[Video::Screen::Type::TOP];
+		}
+
+		if (key == "bot") {
+			return &Video::screens[Video::Screen::Type::BOT];
+		}
+
+		if (key == "joint") {
+			return &Video::screens[Video::Screen::Type::JOINT];
+		}
+
+		return nullptr;
+	}
+
+	// every row kernel works on whole 16 pixel blocks
+	static_assert(CAP_WIDTH % 16 == 0);
+
+	static inline void dispatch() {
+		const char *kernel = "scalar";
+
+#ifdef SIMD_X86
+		if (SDL_HasAVX2()) {
+			Video::p_row = Video::row_avx2;
+			kernel = "avx2";
+		}
+
+		else if (SDL_HasSSSE3()) {
+			Video::p_row = Video::row_ssse3;
+			kernel = "ssse3";
+		}
+
+		else if (SDL_HasSSE2()) {
+			Video::p_row = Video::row_sse2;
+			kernel = "sse2";
+		}
+#endif
+
+#ifdef SIMD_NEON
+		if (SDL_HasNEON()) {
+			Video::p_row = Video::row_neon;
+			kernel = "neon";
+		}
+#endif
+
+		printf("[%s] Using %s deinterleave.\n", NAME, kernel);
+
+		kernel = "scalar";
+
+#if defined(SIMD_X86) && defined(__x86_64__)
+		if (SDL_HasSSE42()) {
+			Video::p_hash = Video::hash_sse42;
+			kernel = "sse4.2 crc32";
+		}
+#endif
+
+#if defined(SIMD_NEON) && defined(__ARM_FEATURE_CRC32)
+		Video::p_hash = Video::hash_crc32;
+		kernel = "crc32";
+#endif
+
+		printf("[%s] Using %s row hashing.\n", NAME, kernel);
+	}
+
+	static inline void init() {
+		Video::screens[Video::Screen::Type::TOP].reset();
+		Video::screens[Video::Screen::Type::BOT].reset();
+		Video::screens[Video::Screen::Type::JOINT].reset();
+
+		if (!((Video::screens[Video::Screen::Type::JOINT].m_window != nullptr) ^ Video::split)) {
+			Video::screens[Video::Screen::Type::TOP].toggle();
+			Video::screens[Video::Screen::Type::BOT].toggle();
+			Video::screens[Video::Screen::Type::JOINT].toggle();
+		}
+
+		if (Video::split) {
+			Video::screens[Video::Screen::Type::TOP].move();
+			Video::screens[Video::Screen::Type::BOT].move();
+		}
+		else {
+			Video::screens[Video::Screen::Type::JOINT].move();
+		}
+	}
+
+	static inline void blank() {
+		Stats::idle();
+
+		memset(Video::buf, 0x00, FRAME_SIZE_RGBA);
+
+		unsigned char* image = nullptr;
+		unsigned width, height;
+
+		unsigned error = lodepng_decode32_file(&image, &width, &height, (getExecutionPath() + "blank.png").c_str());
+		if (error) {
+			printf("Error %u: %s\n", error, lodepng_error_text(error));
+		}else{
+			memcpy(Video::buf, image, FRAME_SIZE_RGBA);
+			free(image);
+		}
+
+		if (Video::opengl) {
+			Video::weave(Video::buf, Video::woven);
+		}
+		
+		// Update all screen textures
+		bool shared = false;
+
+		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
+			Video::Screen &screen = Video::screens[i];
+
+			if (!screen.m_window) {
+				continue;
+			}
+
+			screen.fit();
+
+			if (screen.m_in_texture) {
+				SDL_UpdateTexture(screen.m_in_texture, nullptr, &Video::buf[CAP_WIDTH * 4 * screen.m_first], CAP_WIDTH * 4);
+			}
+
+			if (screen.m_context && !shared) {
+				screen.upload(Video::woven);
+				shared = true;
+			}
+		}
+
+		// the next capture frame has to replace the placeholder everywhere
+		Video::invalidate();
+		Video::draw();
+	}
+
+	static inline void render() {
+		while (g_running) {
+			Video::poll();
+			Stats::tick(&Video::mailbox);
+
+			if (!Capture::connected) {
+				Video::blank();
+				SDL_Delay(5);
+
+				continue;
+			}
+
+			// waiting with a timeout keeps the events flowing even if the capture stalls
+			int ready = Video::mailbox.take(5);
+
+			if (ready == TRANSFER_ABORT) {
+				continue;
+			}
+
+			if (Capture::starting) {
+				Video::blank();
+				continue;
+			}
+
+			uint64_t completed = Stats::completion(ready);
+			uint64_t taken = Stats::stage(Stats::queue, completed);
+
+			if (!Video::load(Capture::buf[ready], &Capture::read[ready])) {
+				continue;
+			}
+
+			int screenshot = Video::Screenshot::grab(Capture::buf[ready]);
+
+			// whatever got uploaded from a refilled slot can't be trusted, so every screen gets it again whole
+			if (!Video::mailbox.release()) {
+				Video::Screenshot::submit(screenshot, false);
+				Video::invalidate();
+				continue;
+			}
+
+			Video::Screenshot::submit(screenshot, true);
+
+			// the whole load, the row hashing and the unweaving included, which map also times on its own
+			uint64_t uploaded = Stats::stage(Stats::load, taken);
+
+			if (!Video::draw()) {
+				Stats::unchanged();
+				continue;
+			}
+
+			Stats::presented(uploaded, completed);
+		}
+	}
+
+
+
+private:
+	friend class Bench;
+	friend class Convert;
+	friend class Headless;
+	friend class Share;
+
+	// only the blank placeholder is staged here, capture frames go straight into the textures
+	static inline UCHAR buf[FRAME_SIZE_RGBA];
+	static inline UCHAR woven[FRAME_SIZE_RGB];
+
+	static inline void toggleSplit() {
+		if (g_kmsdrm) {
+			return;
+		} 
+
+		Video::split ^= true;
+		Video::swap();
+	}
+
+	static inline void swap() {
+		Video::screens[Video::Screen::Type::TOP].toggle();
+		Video::screens[Video::Screen::Type::BOT].toggle();
+		Video::screens[Video::Screen::Type::JOINT].toggle();
+
+		if (Video::split) {
+			Video::screens[Video::Screen::Type::TOP].move();
+			Video::screens[Video::Screen::Type::BOT].move();
+		}
+		else {
+			Video::screens[Video::Screen::Type::JOINT].move();
+		}
+	}
+
+	static inline void poll() {
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			switch (event.type) {
+			case SDL_QUIT:
+				g_running = false;
+				break;
+
+			case SDL_WINDOWEVENT:
+				if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+					g_running = false;
+				}
+				if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+					for (Video::Screen &screen : Video::screens) {
+						if (screen.m_window && SDL_GetWindowID(screen.m_window) == event.window.windowID) {
+							screen.resized(event.window.data1, event.window.data2);
+						}
+					}
+				}
+				Video::refresh();
+				break;
+
+			case SDL_KEYDOWN:
+				handleKeyDown(event);
+				Video::refresh();
+				break;
+
+			case SDL_KEYUP:
+				handleKeyUp(event);
+				Video::refresh();
+				break;
+			}
+		}
+	}
+
+	static inline void handleKeyDown(const SDL_Event& event) {
+		// Get the focused window
+		Screen* focusedScreen = getFocusedScreen();
+		
+		switch (event.key.keysym.sym) {
+		// Global controls (affect all windows)
+		case SDLK_MINUS:
+			Video::brightness = Video::brightness > 5 ? Video::brightness / 5 * 5 - 5 : 0;
+			break;
+
+		case SDLK_EQUALS:
+		case SDLK_PLUS:
+			Video::brightness = Video::brightness < 95 ? Video::brightness / 5 * 5 + 5 : 100;
+			break;
+
+		case SDLK_COMMA:
+			Audio::volume = Audio::volume > 5 ? Audio::volume / 5 * 5 - 5 : 0;
+			break;
+
+		case SDLK_PERIOD:
+			Audio::volume = Audio::volume < 95 ? Audio::volume / 5 * 5 + 5 : 100;
+			break;
+
+		// Window-specific controls
+		case SDLK_DOWN:
+			if (focusedScreen) {
+				focusedScreen->m_scale = focusedScreen->m_scale > 1.5 ? 
+					static_cast<int>(focusedScreen->m_scale / 0.5) * 0.5 - 0.5 : 1.0;
+			}
+			break;
+
+		case SDLK_UP:
+			if (focusedScreen) {
+				focusedScreen->m_scale = focusedScreen->m_scale < 4.0 ? 
+					static_cast<int>(focusedScreen->m_scale / 0.5) * 0.5 + 0.5 : 4.5;
+			}
+			break;
+
+		case SDLK_LEFT:
+			if(g_kmsdrm) {
+				if(g_numdisplays == 1){
+					Video::screens[Video::Screen::Type::JOINT].m_fulltype = static_cast<Video::Screen::Fulltype>(((Video::screens[Video::Screen::Type::JOINT].m_fulltype - 1) % Video::Screen::Fulltype::MODS + Video::Screen::Fulltype::MODS) % Video::Screen::Fulltype::MODS);
+					Video::screens[Video::Screen::Type::JOINT].move();
+				}
+			}
+			else if (focusedScreen) {
+				std::swap(focusedScreen->m_width, focusedScreen->m_height);
+				focusedScreen->rotateLeft();
+				focusedScreen->move();
+			}
+			break;
+
+		case SDLK_RIGHT:
+			if(g_kmsdrm){
+				if(g_numdisplays == 1){
+					Video::screens[Video::Screen::Type::JOINT].m_fulltype = static_cast<Video::Screen::Fulltype>(((Video::screens[Video::Screen::Type::JOINT].m_fulltype + 1) % Video::Screen::Fulltype::MODS + Video::Screen::Fulltype::MODS) % Video::Screen::Fulltype::MODS);
+					Video::screens[Video::Screen::Type::JOINT].move();
+				}
+			}
+			else if (focusedScreen) {
+				std::swap(focusedScreen->m_width, focusedScreen->m_height);
+				focusedScreen->rotateRight();
+				focusedScreen->move();
+			}
+			break;
+
+		case SDLK_LEFTBRACKET:
+		case SDL_SCANCODE_CUT:
+			if(g_kmsdrm && g_numdisplays > 1){
+				Video::screens[Video::Screen::Type::TOP].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				Video::screens[Video::Screen::Type::BOT].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				Video::screens[Video::Screen::Type::TOP].crop();
+				Video::screens[Video::Screen::Type::BOT].crop();
+				Video::screens[Video::Screen::Type::TOP].reset();
+				Video::screens[Video::Screen::Type::BOT].reset();
+			}
+			else if (focusedScreen) {
+				focusedScreen->m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop - 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				focusedScreen->crop();
+				focusedScreen->move();
+			}
+			break;
+
+		case SDLK_RIGHTBRACKET:
+		case SDL_SCANCODE_PASTE:
+			if(g_kmsdrm && g_numdisplays > 1){
+				Video::screens[Video::Screen::Type::TOP].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				Video::screens[Video::Screen::Type::BOT].m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				Video::screens[Video::Screen::Type::TOP].crop();
+				Video::screens[Video::Screen::Type::BOT].crop();
+				Video::screens[Video::Screen::Type::TOP].reset();
+				Video::screens[Video::Screen::Type::BOT].reset();
+			}
+			else if (focusedScreen) {
+				focusedScreen->m_crop = static_cast<Video::Screen::Crop>(((focusedScreen->m_crop + 1) % Video::Screen::Crop::COUNT + Video::Screen::Crop::COUNT) % Video::Screen::Crop::COUNT);
+				focusedScreen->crop();
+				focusedScreen->move();
+			}
+			break;
+		}
+	}
+
+	static inline void handleKeyUp(const SDL_Event& event) {
+		Screen* focusedScreen = getFocusedScreen();
+		
+		switch (event.key.keysym.sym) {
+		// Global controls
+		case SDLK_ESCAPE:
+			if (!Capture::auto_connect) {
+				Capture::connected ? Capture::disconnecting = true : Capture::connected = Capture::connect();
+			}
+			break;
+
+		case SDLK_0:
+			Video::brightness = 100;
+			break;
+
+		case SDLK_TAB:
+			Video::toggleSplit();
+			break;
+
+		case SDLK_m:
+			Audio::mute ^= true;
+			break;
+
+		case SDLK_r:
+			Recorder::toggle();
+			break;
+
+		case SDLK_c:
+			Clip::save();
+			break;
+
+		case SDLK_s:
+			Video::Screenshot::request((event.key.keysym.mod & KMOD_SHIFT) ? Video::Screenshot::burst : 1,
+				focusedScreen ? static_cast<int>(focusedScreen - Video::screens) : Video::Screen::Type::JOINT);
+			break;
+
+		// Replay controls
+		case SDLK_SPACE:
+			if (Replay::active) {
+				Replay::paused = !Replay::paused;
+			}
+			break;
+
+		case SDLK_n:
+			if (Replay::active) {
+				Replay::paused = true;
+				++Replay::steps;
+			}
+			break;
+
+		case SDLK_f:
+			if (Replay::active) {
+				Replay::speed = Replay::speed < REPLAY_SPEED_MAX ? Replay::speed * 2 : 1;
+			}
+			break;
+
+		case SDLK_PAGEUP:
+			if (Replay::active) {
+				Replay::jump -= REPLAY_JUMP;
+			}
+			break;
+
+		case SDLK_PAGEDOWN:
+			if (Replay::active) {
+				Replay::jump += REPLAY_JUMP;
+			}
+			break;
+
+		case SDLK_HOME:
+			if (Replay::active) {
+				Replay::jump = INT64_MIN / 2;
+			}
+			break;
+
+		// Window-specific controls
+		case SDLK_b:
+			if(g_kmsdrm && g_numdisplays > 1){
+				Video::screens[Video::Screen::Type::TOP].m_blur ^= true;
+				Video::screens[Video::Screen::Type::BOT].m_blur ^= true;
+				Video::screens[Video::Screen::Type::TOP].blur();
+				Video::screens[Video::Screen::Type::BOT].blur();
+				Video::screens[Video::Screen::Type::TOP].reset();
+				Video::screens[Video::Screen::Type::BOT].reset();
+			}
+			else if (focusedScreen) {
+				focusedScreen->m_blur ^= true;
+				focusedScreen->blur();
+				focusedScreen->reset();
+			}
+			break;
+
+		// Layout controls
+		case SDLK_F1:
+		case SDLK_F2:
+		case SDLK_F3:
+		case SDLK_F4:
+		case SDLK_F5:
+		case SDLK_F6:
+		case SDLK_F7:
+		case SDLK_F8:
+		case SDLK_F9:
+		case SDLK_F10:
+		case SDLK_F11:
+		case SDLK_F12:
+			if (!g_safe_mode) {
+				if (event.key.keysym.mod & KMOD_CTRL) {
+					Video::p_save(CONF_DIR + "presets/", "layout" + std::to_string(event.key.keysym.sym - SDLK_F1 + 1) + ".conf");
+				}
+				else {
+					Video::p_load(CONF_DIR + "presets/", "layout" + std::to_string(event.key.keysym.sym - SDLK_F1 + 1) + ".conf");
+					Video::init();
+				}
+			}
+			break;
+		}
+	}
+
+	static inline Screen* getFocusedScreen() {
+		// Find the currently focused window
+		SDL_Window* focusedWindow = SDL_GetKeyboardFocus();
+		if (!focusedWindow) return nullptr;
+		
+		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
+			if (Video::screens[i].m_window == focusedWindow) {
+				return &Video::screens[i];
+			}
+		}
+		return nullptr;
+	}
+
+	// indexed by the top and bottom screen types, the joint one being both
+	static inline Damage damage[2];
+
+	static inline uint64_t hashes[CAP_HEIGHT];
+
+	// the changed rows a screen can show, a stale one taking every row it can show
+	static inline Damage damaged(int type, const Video::Screen &screen) {
+		int first = screen.m_first;
+		int last = screen.m_last;
+
+		if (!screen.m_stale) {
+			Damage changed;
+
+			if (type != Video::Screen::Type::BOT) {
+				changed.add(Video::damage[Video::Screen::Type::TOP]);
+			}
+
+			if (type != Video::Screen::Type::TOP) {
+				changed.add(Video::damage[Video::Screen::Type::BOT]);
+			}
+
+			first = std::max(first, changed.first);
+			last = std::min(last, changed.last);
+		}
+
+		Damage damage;
+
+		for (int i = 0; i < CAP_HEIGHT; ++i) {
+			int row = Video::unweave(i);
+
+			if (row >= first && row < last) {
+				damage.add(i, row);
+			}
+		}
+
+		return damage;
+	}
+
+	// games running below 60 fps or leaving a screen still repeat most rows, which then don't get unwoven, uploaded or drawn again
+	static inline bool load(UCHAR *p_buf, ULONG *p_read) {
+		if (*p_read < FRAME_SIZE_RGB) {
+			return false;
+		}
+
+		Video::compare(p_buf);
+
+		// the shared texture takes the raw rows every opengl window needs, each going up once however many windows show it
+		Damage shared[Video::Screen::Type::SIZE];
+		Video::Screen *p_shared = nullptr;
+
+		int count = 0;
+
+		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
+			Video::Screen &screen = Video::screens[i];
+
+			if (!screen.m_window) {
+				continue;
+			}
+
+			screen.fit();
+
+			Damage damage = Video::damaged(i, screen);
+
+			if (damage.empty()) {
+				continue;
+			}
+
+			if (screen.m_in_texture) {
+				Video::upload(screen.m_in_texture, p_buf, damage.first, damage.last, screen.m_first);
+			}
+
+			if (screen.m_context) {
+				shared[count++] = damage;
+				p_shared = &screen;
+			}
+
+			screen.m_stale = false;
+			screen.m_redraw = true;
+		}
+
+		if (p_shared) {
+			Video::share(p_shared, p_buf, shared, count);
+		}
+
+		return true;
+	}
+
+	// overlapping raw ranges are merged first, the top and bottom screens' rows being interleaved
+	static inline void share(Video::Screen *p_screen, const UCHAR *p_buf, Damage *p_damage, int count) {
+		std::sort(p_damage, p_damage + count, [](const Damage &a, const Damage &b) {
+			return a.raw_first < b.raw_first;
+		});
+
+		Damage range = p_damage[0];
+
+		for (int i = 1; i < count; ++i) {
+			if (p_damage[i].raw_first <= range.raw_last) {
+				range.add(p_damage[i]);
+				continue;
+			}
+
+			p_screen->upload(p_buf, range.raw_first, range.raw_last);
+			range = p_damage[i];
+		}
+
+		p_screen->upload(p_buf, range.raw_first, range.raw_last);
+	}
+
+	static inline void compare(const UCHAR *p_buf) {
+		Video::damage[Video::Screen::Type::TOP] = Video::damage[Video::Screen::Type::BOT] = Damage();
+
+		for (int i = 0; i < CAP_HEIGHT; ++i) {
+			uint64_t hash = Video::p_hash(&p_buf[3 * CAP_WIDTH * i]);
+
+			if (hash == Video::hashes[i]) {
+				continue;
+			}
+
+			int row = Video::unweave(i);
+
+			Video::hashes[i] = hash;
+			Video::damage[row < TOP_RES / CAP_WIDTH ? Video::Screen::Type::TOP : Video::Screen::Type::BOT].add(i, row);
+		}
+
+		Stats::captured(!Video::damage[Video::Screen::Type::TOP].empty() || !Video::damage[Video::Screen::Type::BOT].empty());
+	}
+
+	static inline void invalidate() {
+		memset(Video::hashes, 0, sizeof(Video::hashes));
+
+		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
+			Video::screens[i].m_stale = true;
+			Video::screens[i].m_redraw = true;
+		}
+	}
+
+	static inline void refresh() {
+		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
+			Video::screens[i].m_redraw = true;
+		}
+	}
+
+	// unweaves straight into the locked streaming texture so the frame is written once instead of being staged and copied again by the driver,
+	// locking only the rows that changed so the rest of the texture is left as it was, the texture itself starting at the origin row
+	static inline void upload(SDL_Texture *p_texture, UCHAR *p_buf, int first, int last, int origin) {
+		SDL_Rect rect = { 0, first - origin, CAP_WIDTH, last - first };
+
+		void *p_pixels;
+		int pitch;
+
+		if (SDL_LockTexture(p_texture, &rect, &p_pixels, &pitch)) {
+			uint64_t start = Stats::now();
+
+			Video::map(p_buf, Video::buf, CAP_WIDTH * 4, first, last);
+			Stats::stage(Stats::map, start);
+
+			SDL_UpdateTexture(p_texture, &rect, Video::buf, CAP_WIDTH * 4);
+			return;
+		}
+
+		uint64_t start = Stats::now();
+
+		Video::map(p_buf, static_cast<UCHAR*>(p_pixels), pitch, first, last);
+		Stats::stage(Stats::map, start);
+
+		SDL_UnlockTexture(p_texture);
+	}
+
+	// the top and bottom screens arrive as alternating rows once past the rows only the top screen has
+	static inline int unweave(int row) {
+		if (row < DELTA_RES / CAP_WIDTH) {
+			return row;
+		}
+
+		return (row & 1 ? DELTA_RES / CAP_WIDTH : TOP_RES / CAP_WIDTH) + (row - DELTA_RES / CAP_WIDTH) / 2;
+	}
+
+	// unweaves the rows from first to last, the first one landing at the start of the output
+	static inline void map(UCHAR *p_in, UCHAR *p_out, int pitch = CAP_WIDTH * 4, int first = 0, int last = CAP_HEIGHT) {
+		for (int i = 0; i < CAP_HEIGHT; ++i) {
+			int row = Video::unweave(i);
+
+			if (row >= first && row < last) {
+				Video::p_row(&p_in[3 * CAP_WIDTH * i], &p_out[pitch * (row - first)]);
+			}
+		}
+	}
+
+	// inverse of map, only used to put the blank placeholder through the shader path
+	static inline void weave(UCHAR *p_in, UCHAR *p_out) {
+		for (int i = 0, j = DELTA_RES, k = TOP_RES; i < CAP_RES; ++i) {
+			int o = i < DELTA_RES ? i : (i / CAP_WIDTH & 1) ? j++ : k++;
+
+			p_out[3 * i + 0] = p_in[4 * o + 0];
+			p_out[3 * i + 1] = p_in[4 * o + 1];
+			p_out[3 * i + 2] = p_in[4 * o + 2];
+		}
+	}
+
+	// scalar fallback and the reference every simd row kernel has to match bit for bit
+	static inline void row(const UCHAR *p_in, UCHAR *p_out) {
+		for (int i = 0; i < CAP_WIDTH; ++i) {
+			p_out[4 * i + 0] = p_in[3 * i + 0];
+			p_out[4 * i + 1] = p_in[3 * i + 1];
+			p_out[4 * i + 2] = p_in[3 * i + 2];
+			p_out[4 * i + 3] = 0xff;
+		}
+	}
+
+	static inline void (*p_row) (const UCHAR *p_in, UCHAR *p_out) = Video::row;
+
+#ifdef SIMD_X86
+	// moves each of the four pixels packed in the low 12 bytes up by its index to make room for its alpha
+	SIMD_TARGET("sse2") static inline __m128i expand(__m128i rgb) {
+		const __m128i mask = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+
+		return _mm_or_si128(_mm_or_si128(_mm_and_si128(rgb, mask), _mm_and_si128(_mm_slli_si128(rgb, 1), _mm_slli_si128(mask, 4))),
+			_mm_or_si128(_mm_and_si128(_mm_slli_si128(rgb, 2), _mm_slli_si128(mask, 8)), _mm_and_si128(_mm_slli_si128(rgb, 3), _mm_slli_si128(mask, 12))));
+	}
+
+	SIMD_TARGET("sse2") static inline void row_sse2(const UCHAR *p_in, UCHAR *p_out) {
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+		for (int i = 0; i < CAP_WIDTH; i += 16, p_in += 48, p_out += 64) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 16));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 32));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out), _mm_or_si128(Video::expand(a), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 16), _mm_or_si128(Video::expand(_mm_or_si128(_mm_srli_si128(a, 12), _mm_slli_si128(b, 4))), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 32), _mm_or_si128(Video::expand(_mm_or_si128(_mm_srli_si128(b, 8), _mm_slli_si128(c, 8))), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 48), _mm_or_si128(Video::expand(_mm_srli_si128(c, 4)), alpha));
+		}
+	}
+
+	SIMD_TARGET("ssse3") static inline void row_ssse3(const UCHAR *p_in, UCHAR *p_out) {
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+		for (int i = 0; i < CAP_WIDTH; i += 16, p_in += 48, p_out += 64) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 16));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 32));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out), _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 16), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 32), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p_out + 48), _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+		}
+	}
+
+	SIMD_TARGET("avx2") static inline void row_avx2(const UCHAR *p_in, UCHAR *p_out) {
+		const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha = _mm256_set1_epi32(0xff000000);
+
+		for (int i = 0; i < CAP_WIDTH; i += 16, p_in += 48, p_out += 64) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 16));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_in + 32));
+
+			__m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(a), _mm_alignr_epi8(b, a, 12), 1);
+			__m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_alignr_epi8(c, b, 8)), _mm_srli_si128(c, 4), 1);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_out), _mm256_or_si256(_mm256_shuffle_epi8(lo, shuffle), alpha));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p_out + 32), _mm256_or_si256(_mm256_shuffle_epi8(hi, shuffle), alpha));
+		}
+	}
+#endif
+
+#ifdef SIMD_NEON
+	static inline void row_neon(const UCHAR *p_in, UCHAR *p_out) {
+		uint8x16x4_t rgba;
+		rgba.val[3] = vdupq_n_u8(0xff);
+
+		for (int i = 0; i < CAP_WIDTH; i += 16, p_in += 48, p_out += 64) {
+			uint8x16x3_t rgb = vld3q_u8(p_in);
+
+			rgba.val[0] = rgb.val[0];
+			rgba.val[1] = rgb.val[1];
+			rgba.val[2] = rgb.val[2];
+
+			vst4q_u8(p_out, rgba);
+		}
+	}
+#endif
+
+	// scalar fallback, a multiply and fold per word being enough to tell a changed row from an unchanged one, over two
+	// chains so they overlap
+	static inline uint64_t hash(const UCHAR *p_in) {
+		uint64_t a = 0x9e3779b97f4a7c15;
+		uint64_t b = 0xc2b2ae3d27d4eb4f;
+
+		for (int i = 0; i < CAP_WIDTH * 3; i += 16) {
+			uint64_t words[2];
+			memcpy(words, &p_in[i], 16);
+
+			a = (a ^ words[0]) * 0xff51afd7ed558ccd;
+			b = (b ^ words[1]) * 0xc4ceb9fe1a85ec53;
+			a ^= a >> 32;
+			b ^= b >> 29;
+		}
+
+		return a ^ (b << 1 | b >> 63);
+	}
+
+	static inline uint64_t (*p_hash) (const UCHAR *p_in) = Video::hash;
+
+#if defined(SIMD_X86) && defined(__x86_64__)
+	// two independent crc chains over alternating words make up the two halves of the hash and keep the crc unit busy
+	SIMD_TARGET("sse4.2") static inline uint64_t hash_sse42(const UCHAR *p_in) {
+		uint64_t a = 0;
+		uint64_t b = UINT32_MAX;
+
+		for (int i = 0; i < CAP_WIDTH * 3; i += 16) {
+			uint64_t words[2];
+			memcpy(words, &p_in[i], 16);
+
+			a = _mm_crc32_u64(a, words[0]);
+			b = _mm_crc32_u64(b, words[1]);
+		}
+
+		return a << 32 | b;
+	}
+#endif
+
+#if defined(SIMD_NEON) && defined(__ARM_FEATURE_CRC32)
+	static inline uint64_t hash_crc32(const UCHAR *p_in) {
+		uint32_t a = 0;
+		uint32_t b = UINT32_MAX;
+
+		for (int i = 0; i < CAP_WIDTH * 3; i += 16) {
+			uint64_t words[2];
+			memcpy(words, &p_in[i], 16);
+
+			a = __crc32cd(a, words[0]);
+			b = __crc32cd(b, words[1]);
+		}
+
+		return static_cast<uint64_t>(a) << 32 | b;
+	}
+#endif
+
+	// only the windows whose rows changed or that need drawing again are presented, false when none was
+	static inline bool draw() {
+		bool drawn = false;
+
+		if (Video::split) {
+			for (int i = Video::Screen::Type::TOP; i <= Video::Screen::Type::BOT; ++i) {
+				if (Video::screens[i].m_redraw) {
+					Video::screens[i].draw();
+					Video::screens[i].m_redraw = false;
+
+					drawn = true;
+				}
+			}
+		}
+
+		else if (Video::screens[Video::Screen::Type::JOINT].m_redraw) {
+			Video::screens[Video::Screen::Type::JOINT].draw(
+				&Video::screens[Video::Screen::Type::TOP].m_in_rect,
+				&Video::screens[Video::Screen::Type::TOP].m_out_rect,
+				&Video::screens[Video::Screen::Type::BOT].m_in_rect,
+				&Video::screens[Video::Screen::Type::BOT].m_out_rect
+			);
+			Video::screens[Video::Screen::Type::JOINT].m_redraw = false;
+
+			drawn = true;
+		}
+
+		return drawn;
+	}
+};
+
+// streams every transfer to two file descriptors with no window, no renderer and no audio device, the unwoven frames as
+// yuv4mpeg2 and the samples as wav, both as they come and with a repeated frame and silence standing in for any transfer
+// missed while the descriptors were blocked, so the two never drift apart and nothing queues up
+class Headless {
+public:
+	static inline bool enabled = false;
+
+	static inline int video = -1;
+	static inline int audio = -1;
+
+	static inline Mailbox mailbox{Mailbox::Policy::EVERY};
+
+	// the frames leave the way the capture is laid out, 240 pixels wide with the top screen above the bottom one, which
+	// a counterclockwise transpose turns upright
+	static inline bool open() {
+		signal(SIGPIPE, SIG_IGN);
+		signal(SIGINT, Headless::stop);
+		signal(SIGTERM, Headless::stop);
+
+		// the log moves to stderr whenever stdout carries either stream
+		if (Headless::video == STDOUT_FILENO || Headless::audio == STDOUT_FILENO) {
+			int out = dup(STDOUT_FILENO);
+
+			Headless::video = Headless::video == STDOUT_FILENO ? out : Headless::video;
+			Headless::audio = Headless::audio == STDOUT_FILENO ? out : Headless::audio;
+
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+
+		setvbuf(stdout, nullptr, _IOLBF, 0);
+
+		std::string header = "YUV4MPEG2 W" + std::to_string(CAP_WIDTH) + " H" + std::to_string(CAP_HEIGHT) +
+			" F" + std::to_string(FRAMERATE_NUM) + ":" + std::to_string(FRAMERATE_DEN) + " Ip A1:1 C420jpeg\n";
+
+		if (!Headless::write(Headless::video, header.data(), header.size())) {
+			printf("[%s] Headless video write failed.\n", NAME);
+			return false;
+		}
+
+		// the sizes stay unknown while streaming, and get filled in when the audio went to a file
+		Wave wave = Headless::wave(UINT32_MAX);
+
+		if (!Headless::write(Headless::audio, &wave, sizeof(wave))) {
+			printf("[%s] Headless audio write failed.\n", NAME);
+			return false;
+		}
+
+		return true;
+	}
+
+	static inline void run() {
+		uint64_t missed = 0;
+
+		while (g_running) {
+			int ready = Headless::mailbox.take(5);
+
+			if (ready == TRANSFER_ABORT || Capture::starting || Capture::read[ready] < FRAME_SIZE_RGB) {
+				continue;
+			}
+
+			int frame = !Headless::frame;
+			ULONG read = Capture::read[ready];
+
+			Video::map(Capture::buf[ready], Headless::rgba);
+			Headless::convert(Headless::rgba, Headless::frames[frame]);
+
+			// the samples are little endian like the wav they go into
+			int samples = std::min<ULONG>(read - FRAME_SIZE_RGB, SAMPLE_SIZE_8);
+			memcpy(Headless::samples, &Capture::buf[ready][FRAME_SIZE_RGB], samples);
+
+			bool released = Headless::mailbox.release();
+
+			for (uint64_t total = Headless::mailbox.m_drops + Headless::mailbox.m_overruns; missed < total; ++missed) {
+				if (!Headless::emit(Headless::frames[Headless::frame], Headless::silence, SAMPLE_SIZE_8)) {
+					return;
+				}
+			}
+
+			if (!released) {
+				continue;
+			}
+
+			Headless::frame = frame;
+
+			if (!Headless::emit(Headless::frames[frame], Headless::samples, samples)) {
+				return;
+			}
+		}
+	}
+
+	static inline void close() {
+		Wave wave = Headless::wave(Headless::written);
+
+		if (Headless::written < UINT32_MAX - sizeof(wave) && lseek(Headless::audio, 0, SEEK_SET) == 0) {
+			Headless::write(Headless::audio, &wave, sizeof(wave));
+		}
+
+		printf("[%s] Headless wrote %llu frames and %llu bytes of audio.\n", NAME,
+			static_cast<unsigned long long>(Headless::frames_written), static_cast<unsigned long long>(Headless::written));
+	}
+
+	static inline void dispatch() {
+		const char *kernel = "scalar";
+
+#ifdef SIMD_X86
+		if (SDL_HasSSE2()) {
+			Headless::p_yuv = Headless::yuv_sse2;
+			kernel = "sse2";
+		}
+#endif
+
+#ifdef SIMD_NEON
+		if (SDL_HasNEON()) {
+			Headless::p_yuv = Headless::yuv_neon;
+			kernel = "neon";
+		}
+#endif
+
+		printf("[%s] Using %s colour conversion.\n", NAME, kernel);
+	}
+
+private:
+	friend class Bench;
+	friend class Convert;
+
+	struct Wave {
+		char riff[4];
+		uint32_t riff_size;
+		char wave[4];
+		char fmt[4];
+		uint32_t fmt_size;
+		uint16_t format;
+		uint16_t channels;
+		uint32_t rate;
+		uint32_t byte_rate;
+		uint16_t block;
+		uint16_t bits;
+		char data[4];
+		uint32_t data_size;
+	};
+
+	static inline UCHAR rgba[FRAME_SIZE_RGBA];
+	static inline UCHAR frames[2][YUV_SIZE];
+	static inline int frame = 0;
+
+	static inline UCHAR samples[SAMPLE_SIZE_8];
+	static inline const UCHAR silence[SAMPLE_SIZE_8] = {};
+
+	static inline uint64_t frames_written = 0;
+	static inline uint64_t written = 0;
+
+	static inline void stop(int) {
+		g_running = false;
+	}
+
+	static inline Wave wave(uint32_t size) {
+		Wave wave = { { 'R', 'I', 'F', 'F' }, size == UINT32_MAX ? size : size + 36, { 'W', 'A', 'V', 'E' }, { 'f', 'm', 't', ' ' }, 16, 1, AUDIO_CHANNELS,
+			SAMPLE_RATE, SAMPLE_RATE * AUDIO_CHANNELS * 2, AUDIO_CHANNELS * 2, 16, { 'd', 'a', 't', 'a' }, size };
+
+		return wave;
+	}
+
+	static inline bool write(int fd, const void *p_buf, size_t size) {
+		const char *p_out = static_cast<const char*>(p_buf);
+
+		while (size) {
+			ssize_t done = ::write(fd, p_out, size);
+
+			if (done < 0 && errno == EINTR) {
+				continue;
+			}
+
+			if (done <= 0) {
+				return false;
+			}
+
+			p_out += done;
+			size -= done;
+		}
+
+		return true;
+	}
+
+	// a whole frame goes out in one call, and a reader gone away ends the stream
+	static inline bool emit(const UCHAR *p_frame, const UCHAR *p_samples, int samples) {
+		static const char marker[] = "FRAME\n";
+
+		struct iovec parts[2] = { { const_cast<char*>(marker), sizeof(marker) - 1 }, { const_cast<UCHAR*>(p_frame), YUV_SIZE } };
+		ssize_t done = writev(Headless::video, parts, 2);
+
+		while (done < 0 && errno == EINTR) {
+			done = writev(Headless::video, parts, 2);
+		}
+
+		// whatever a pipe didn't take in one go follows it
+		size_t header = std::min<size_t>(std::max<ssize_t>(done, 0), parts[0].iov_len);
+		size_t body = std::max<ssize_t>(done, 0) - header;
+
+		if (done < 0 || !Headless::write(Headless::video, marker + header, parts[0].iov_len - header) || !Headless::write(Headless::video, p_frame + body, YUV_SIZE - body)) {
+			printf("[%s] Headless video write failed.\n", NAME);
+			g_running = false;
+			return false;
+		}
+
+		if (!Headless::write(Headless::audio, p_samples, samples)) {
+			printf("[%s] Headless audio write failed.\n", NAME);
+			g_running = false;
+			return false;
+		}
+
+		++Headless::frames_written;
+		Headless::written += samples;
+
+		return true;
+	}
+
+	// 4:2:0 bt.601 in its limited range, two rows of the unwoven frame at a time
+	static inline void convert(const UCHAR *p_in, UCHAR *p_out) {
+		UCHAR *p_y = p_out;
+		UCHAR *p_u = p_out + CAP_RES;
+		UCHAR *p_v = p_u + CAP_RES / 4;
+
+		for (int i = 0; i < CAP_HEIGHT; i += 2) {
+			Headless::p_yuv(&p_in[CAP_WIDTH * 4 * i], &p_y[CAP_WIDTH * i], &p_u[CAP_WIDTH / 2 * (i / 2)], &p_v[CAP_WIDTH / 2 * (i / 2)]);
+		}
+	}
+
+	// scalar fallback and the reference every simd conversion kernel has to match bit for bit, each chroma sample being
+	// taken from the rounded average of its four pixels
+	static inline void yuv(const UCHAR *p_in, UCHAR *p_y, UCHAR *p_u, UCHAR *p_v) {
+		for (int i = 0; i < CAP_WIDTH; i += 2) {
+			int r = 0;
+			int g = 0;
+			int b = 0;
+
+			for (int row = 0; row < 2; ++row) {
+				for (int column = i; column < i + 2; ++column) {
+					const UCHAR *p_pixel = &p_in[CAP_WIDTH * 4 * row + 4 * column];
+
+					p_y[CAP_WIDTH * row + column] = ((66 * p_pixel[0] + 129 * p_pixel[1] + 25 * p_pixel[2] + 128) >> 8) + 16;
+
+					r += p_pixel[0];
+					g += p_pixel[1];
+					b += p_pixel[2];
+				}
+			}
+
+			r = (r + 2) >> 2;
+			g = (g + 2) >> 2;
+			b = (b + 2) >> 2;
+
+			p_u[i / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+			p_v[i / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+		}
+	}
+
+	static inline void (*p_yuv) (const UCHAR *p_in, UCHAR *p_y, UCHAR *p_u, UCHAR *p_v) = Headless::yuv;
+
+#ifdef SIMD_X86
+	// rounded weighted sums of the channels of four 16 bit pixels, two in each register
+	SIMD_TARGET("sse2") static inline __m128i dot(__m128i lo, __m128i hi, __m128i weights) {
+		__m128i a = _mm_shuffle_epi32(_mm_madd_epi16(lo, weights), _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i b = _mm_shuffle_epi32(_mm_madd_epi16(hi, weights), _MM_SHUFFLE(3, 1, 2, 0));
+
+		__m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+
+		return _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+	}
+
+	SIMD_TARGET("sse2") static inline void yuv_sse2(const UCHAR *p_in, UCHAR *p_y, UCHAR *p_u, UCHAR *p_v) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i luma = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+		const __m128i blue = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+		const __m128i red = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+
+		for (int i = 0; i < CAP_WIDTH; i += 8) {
+			__m128i left = zero;
+			__m128i right = zero;
+
+			for (int row = 0; row < 2; ++row) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_in[CAP_WIDTH * 4 * row + 4 * i]));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_in[CAP_WIDTH * 4 * row + 4 * i + 16]));
+
+				__m128i p01 = _mm_unpacklo_epi8(a, zero);
+				__m128i p23 = _mm_unpackhi_epi8(a, zero);
+				__m128i p45 = _mm_unpacklo_epi8(b, zero);
+				__m128i p67 = _mm_unpackhi_epi8(b, zero);
+
+				__m128i y = _mm_add_epi16(_mm_packs_epi32(Headless::dot(p01, p23, luma), Headless::dot(p45, p67, luma)), _mm_set1_epi16(16));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&p_y[CAP_WIDTH * row + i]), _mm_packus_epi16(y, y));
+
+				// each pair of neighbouring pixels summed, for the chroma samples of the first four and the last four pixels
+				left = _mm_add_epi16(left, _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23)));
+				right = _mm_add_epi16(right, _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67)));
+			}
+
+			left = _mm_srli_epi16(_mm_add_epi16(left, _mm_set1_epi16(2)), 2);
+			right = _mm_srli_epi16(_mm_add_epi16(right, _mm_set1_epi16(2)), 2);
+
+			__m128i u = _mm_add_epi32(Headless::dot(left, right, blue), _mm_set1_epi32(128));
+			__m128i v = _mm_add_epi32(Headless::dot(left, right, red), _mm_set1_epi32(128));
+
+			__m128i uv = _mm_packs_epi32(u, v);
+			uv = _mm_packus_epi16(uv, uv);
+
+			int chroma[2] = { _mm_cvtsi128_si32(uv), _mm_cvtsi128_si32(_mm_srli_si128(uv, 4)) };
+
+			memcpy(&p_u[i / 2], &chroma[0], 4);
+			memcpy(&p_v[i / 2], &chroma[1], 4);
+		}
+	}
+#endif
+
+#ifdef SIMD_NEON
+	static inline void yuv_neon(const UCHAR *p_in, UCHAR *p_y, UCHAR *p_u, UCHAR *p_v) {
+		for (int i = 0; i < CAP_WIDTH; i += 8) {
+			uint16x4_t r = vdup_n_u16(0);
+			uint16x4_t g = vdup_n_u16(0);
+			uint16x4_t b = vdup_n_u16(0);
+
+			for (int row = 0; row < 2; ++row) {
+				uint8x8x4_t rgba = vld4_u8(&p_in[CAP_WIDTH * 4 * row + 4 * i]);
+
+				uint16x8_t y = vmull_u8(rgba.val[0], vdup_n_u8(66));
+				y = vmlal_u8(y, rgba.val[1], vdup_n_u8(129));
+				y = vmlal_u8(y, rgba.val[2], vdup_n_u8(25));
+
+				vst1_u8(&p_y[CAP_WIDTH * row + i], vadd_u8(vrshrn_n_u16(y, 8), vdup_n_u8(16)));
+
+				r = vpadal_u8(r, rgba.val[0]);
+				g = vpadal_u8(g, rgba.val[1]);
+				b = vpadal_u8(b, rgba.val[2]);
+			}
+
+			int16x4_t r4 = vreinterpret_s16_u16(vrshr_n_u16(r, 2));
+			int16x4_t g4 = vreinterpret_s16_u16(vrshr_n_u16(g, 2));
+			int16x4_t b4 = vreinterpret_s16_u16(vrshr_n_u16(b, 2));
+
+			int16x4_t u = vmla_n_s16(vmla_n_s16(vmul_n_s16(r4, -38), g4, -74), b4, 112);
+			int16x4_t v = vmla_n_s16(vmla_n_s16(vmul_n_s16(r4, 112), g4, -94), b4, -18);
+
+			u = vadd_s16(vshr_n_s16(vadd_s16(u, vdup_n_s16(128)), 8), vdup_n_s16(128));
+			v = vadd_s16(vshr_n_s16(vadd_s16(v, vdup_n_s16(128)), 8), vdup_n_s16(128));
+
+			UCHAR chroma[8];
+			vst1_u8(chroma, vqmovun_s16(vcombine_s16(u, v)));
+
+			memcpy(&p_u[i / 2], &chroma[0], 4);
+			memcpy(&p_v[i / 2], &chroma[4], 4);
+		}
+	}
+#endif
+};
+
+// publishes every unwoven frame and its audio into a shared memory ring other processes on the same machine map, like an
+// obs source, without ever waiting on them, so a reader that falls behind just finds newer frames when it looks again
+class Share {
+public:
+	// the ring's layout is fixed in shm.h for its readers, so it has to keep up with what a transfer holds
+	static_assert(SHM_WIDTH == CAP_WIDTH && SHM_HEIGHT == CAP_HEIGHT && SHM_FRAME_SIZE == FRAME_SIZE_RGBA);
+	static_assert(SHM_AUDIO_SIZE >= SAMPLE_SIZE_8 && SHM_RATE == SAMPLE_RATE && SHM_CHANNELS == AUDIO_CHANNELS);
+
+	static inline std::string name;
+
+	static inline Mailbox mailbox{Mailbox::Policy::EVERY};
+
+	static inline bool open() {
+		if (Share::name[0] != '/') {
+			Share::name = "/" + Share::name;
+		}
+
+		// a ring left behind by a crash is replaced, anything still mapping it just stops getting frames
+		shm_unlink(Share::name.c_str());
+
+		int fd = shm_open(Share::name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+		if (fd < 0) {
+			printf("[%s] Shared memory \"%s\" open failed.\n", NAME, Share::name.c_str());
+			return false;
+		}
+
+		void *p_map = ftruncate(fd, sizeof(Shm::Header)) ? MAP_FAILED : mmap(nullptr, sizeof(Shm::Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p_map == MAP_FAILED) {
+			printf("[%s] Shared memory \"%s\" map failed.\n", NAME, Share::name.c_str());
+			shm_unlink(Share::name.c_str());
+			return false;
+		}
+
+		Share::p_header = new (p_map) Shm::Header();
+
+		Share::p_header->version = SHM_VERSION;
+		Share::p_header->slots = SHM_SLOTS;
+		Share::p_header->width = CAP_WIDTH;
+		Share::p_header->height = CAP_HEIGHT;
+		Share::p_header->rate = SAMPLE_RATE;
+		Share::p_header->channels = AUDIO_CHANNELS;
+
+		// the magic goes in last so a reader never takes a half written header for a ring
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(Share::p_header->magic, Shm::magic, sizeof(Shm::magic));
+
+		Capture::mailboxes.push_back(&Share::mailbox);
+		Share::thread = std::thread(Share::run);
+
+		printf("[%s] Sharing frames as \"%s\".\n", NAME, Share::name.c_str());
+
+		return true;
+	}
+
+	static inline void close() {
+		if (!Share::p_header) {
+			return;
+		}
+
+		Share::thread.join();
+
+		munmap(Share::p_header, sizeof(Shm::Header));
+		shm_unlink(Share::name.c_str());
+
+		Share::p_header = nullptr;
+
+		printf("[%s] Shared memory published %llu frames, dropped %llu and overran %llu transfers.\n", NAME, static_cast<unsigned long long>(Share::frame),
+			static_cast<unsigned long long>(Share::mailbox.m_drops), static_cast<unsigned long long>(Share::mailbox.m_overruns));
+	}
+
+private:
+	static inline Shm::Header *p_header = nullptr;
+	static inline std::thread thread;
+
+	static inline uint64_t frame = 0;
+
+	// the slot's sequence is odd for as long as it is being written, so a reader that was using it sees it changed once done
+	static inline void run() {
+		while (g_running) {
+			int ready = Share::mailbox.take(5);
+
+			if (ready == TRANSFER_ABORT || Capture::starting || Capture::read[ready] < FRAME_SIZE_RGB) {
+				continue;
+			}
+
+			timespec time;
+			clock_gettime(CLOCK_MONOTONIC, &time);
+
+			Shm::Slot *p_slot = &Share::p_header->slot[Share::frame % SHM_SLOTS];
+			uint64_t sequence = p_slot->sequence.load(std::memory_order_relaxed);
+
+			p_slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			Video::map(Capture::buf[ready], p_slot->pixels);
+
+			p_slot->audio = std::min<ULONG>(Capture::read[ready] - FRAME_SIZE_RGB, SAMPLE_SIZE_8);
+			memcpy(p_slot->samples, &Capture::buf[ready][FRAME_SIZE_RGB], p_slot->audio);
+
+			p_slot->time = static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+
+			// a transfer refilled while it was being copied leaves the slot matching no frame instead of being published
+			bool released = Share::mailbox.release();
+			p_slot->frame = released ? Share::frame : UINT64_MAX;
+
+			p_slot->sequence.store(sequence + 2, std::memory_order_release);
+
+			if (released) {
+				Share::p_header->published.store(++Share::frame, std::memory_order_release);
+			}
+		}
+	}
+};
+
+// streams every transfer to the programs connected to a unix socket, as a recording they can save as is or read as they
+// go. every client gets its own queue, of every transfer up to its depth or of only the latest one, and nothing it does
+// ever blocks, so a client that stalls only loses its own transfers. a client picks its policy by sending a line such as
+// "every 8" or "latest", and otherwise gets every transfer with up to SERVER_DEPTH of them queued
+class Server {
+public:
+	static inline std::string path;
+
+	static inline Mailbox mailbox{Mailbox::Policy::EVERY};
+
+	static inline bool open() {
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+
+		if (Server::path.size() >= sizeof(address.sun_path)) {
+			printf("[%s] Socket \"%s\" path is too long.\n", NAME, Server::path.c_str());
+			return false;
+		}
+
+		memcpy(address.sun_path, Server::path.c_str(), Server::path.size());
+
+		// a socket left behind by a crash is replaced
+		unlink(Server::path.c_str());
+
+		Server::listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (Server::listener < 0 || bind(Server::listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) || listen(Server::listener, SOMAXCONN) || !Server::nonblocking(Server::listener)) {
+			printf("[%s] Socket \"%s\" open failed.\n", NAME, Server::path.c_str());
+
+			if (Server::listener >= 0) {
+				::close(Server::listener);
+				Server::listener = -1;
+			}
+
+			return false;
+		}
+
+		Server::frames.resize(SERVER_FRAMES);
+
+		Capture::mailboxes.push_back(&Server::mailbox);
+		Server::thread = std::thread(Server::run);
+
+		printf("[%s] Serving transfers on \"%s\".\n", NAME, Server::path.c_str());
+
+		return true;
+	}
+
+	static inline void close() {
+		if (Server::listener < 0) {
+			return;
+		}
+
+		Server::thread.join();
+
+		while (!Server::clients.empty()) {
+			Server::disconnect(Server::clients.size() - 1);
+		}
+
+		::close(Server::listener);
+		unlink(Server::path.c_str());
+
+		Server::listener = -1;
+
+		printf("[%s] Socket dropped %llu and overran %llu transfers.\n", NAME,
+			static_cast<unsigned long long>(Server::mailbox.m_drops), static_cast<unsigned long long>(Server::mailbox.m_overruns));
+	}
+
+private:
+	// one copy of a transfer, shared by every client queueing it
+	struct Frame {
+		uint64_t time;
+		uint32_t read;
+		int users;
+		UCHAR buf[BUF_SIZE];
+	};
+
+	struct Client {
+		int fd;
+		Mailbox::Policy policy;
+		int depth;
+
+		// the transfer at the front is the one being sent when some of it already went
+		int queue[SERVER_DEPTH_MAX + 1];
+		Recorder::Record records[SERVER_DEPTH_MAX + 1];
+		int queued;
+		size_t sent;
+
+		bool started;
+		uint64_t start;
+
+		uint64_t delivered;
+		uint64_t drops;
+
+		std::string line;
+	};
+
+	static inline int listener = -1;
+	static inline std::thread thread;
+
+	static inline std::vector<Frame> frames;
+	static inline std::vector<Client> clients;
+
+	static inline void run() {
+		std::vector<pollfd> fds;
+
+		while (g_running) {
+			int ready = Server::mailbox.take(2);
+
+			if (ready != TRANSFER_ABORT && !Capture::starting) {
+				Server::publish(ready);
+			}
+
+			fds.clear();
+			fds.push_back({ Server::listener, POLLIN, 0 });
+
+			for (const Client &client : Server::clients) {
+				fds.push_back({ client.fd, static_cast<short>(client.queued ? POLLIN | POLLOUT : POLLIN), 0 });
+			}
+
+			if (poll(fds.data(), fds.size(), 0) <= 0) {
+				continue;
+			}
+
+			// backwards, so a client going away doesn't move the ones still to go
+			for (size_t i = Server::clients.size(); i-- > 0;) {
+				short events = fds[i + 1].revents;
+
+				if (events & (POLLERR | POLLNVAL) || (events & (POLLIN | POLLHUP) && !Server::receive(i)) || (events & POLLOUT && !Server::flush(i))) {
+					Server::disconnect(i);
+				}
+			}
+
+			if (fds[0].revents & POLLIN) {
+				Server::accept();
 			}
-			break;
+		}
+	}
 
-		case SDLK_0:
-			Video::brightness = 100;
-			break;
+	// the transfer is copied once whatever the number of clients, and not at all without any
+	static inline void publish(int ready) {
+		if (Server::clients.empty()) {
+			Server::mailbox.release();
+			return;
+		}
 
-		case SDLK_TAB:
-			Video::toggleSplit();
-			break;
+		int index = Server::allocate();
+		Frame &frame = Server::frames[index];
 
-		case SDLK_m:
-			Audio::mute ^= true;
-			break;
+		frame.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		frame.read = std::min<ULONG>(Capture::read[ready], BUF_SIZE);
 
-		// Window-specific controls
-		case SDLK_b:
-			if(g_kmsdrm && g_numdisplays > 1){
-				Video::screens[Video::Screen::Type::TOP].m_blur ^= true;
-				Video::screens[Video::Screen::Type::BOT].m_blur ^= true;
-				Video::screens[Video::Screen::Type::TOP].blur();
-				Video::screens[Video::Screen::Type::BOT].blur();
-				Video::screens[Video::Screen::Type::TOP].reset();
-				Video::screens[Video::Screen::Type::BOT].reset();
+		memcpy(frame.buf, Capture::buf[ready], frame.read);
+
+		if (!Server::mailbox.release()) {
+			return;
+		}
+
+		for (Client &client : Server::clients) {
+			Server::enqueue(client, index);
+		}
+	}
+
+	// with every copy taken, the oldest one nobody is in the middle of sending makes room, so the clients losing it are
+	// the ones furthest behind
+	static inline int allocate() {
+		int oldest = -1;
+
+		for (int i = 0; i < SERVER_FRAMES; ++i) {
+			if (!Server::frames[i].users) {
+				return i;
 			}
-			else if (focusedScreen) {
-				focusedScreen->m_blur ^= true;
-				focusedScreen->blur();
-				focusedScreen->reset();
+
+			if (!Server::sending(i) && (oldest < 0 || Server::frames[i].time < Server::frames[oldest].time)) {
+				oldest = i;
 			}
-			break;
+		}
 
-		// Layout controls
-		case SDLK_F1:
-		case SDLK_F2:
-		case SDLK_F3:
-		case SDLK_F4:
-		case SDLK_F5:
-		case SDLK_F6:
-		case SDLK_F7:
-		case SDLK_F8:
-		case SDLK_F9:
-		case SDLK_F10:
-		case SDLK_F11:
-		case SDLK_F12:
-			if (!g_safe_mode) {
-				if (event.key.keysym.mod & KMOD_CTRL) {
-					Video::p_save(CONF_DIR + "presets/", "layout" + std::to_string(event.key.keysym.sym - SDLK_F1 + 1) + ".conf");
-				}
-				else {
-					Video::p_load(CONF_DIR + "presets/", "layout" + std::to_string(event.key.keysym.sym - SDLK_F1 + 1) + ".conf");
-					Video::init();
+		for (Client &client : Server::clients) {
+			for (int j = client.queued - 1; j >= 0; --j) {
+				if (client.queue[j] == oldest) {
+					Server::remove(client, j);
+					++client.drops;
 				}
 			}
-			break;
 		}
+
+		return oldest;
 	}
 
-	static inline Screen* getFocusedScreen() {
-		// Find the currently focused window
-		SDL_Window* focusedWindow = SDL_GetKeyboardFocus();
-		if (!focusedWindow) return nullptr;
-		
-		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
-			if (Video::screens[i].m_window == focusedWindow) {
-				return &Video::screens[i];
+	static inline bool sending(int index) {
+		for (const Client &client : Server::clients) {
+			if (client.sent && client.queue[0] == index) {
+				return true;
 			}
 		}
-		return nullptr;
+
+		return false;
 	}
 
-	static inline bool load(UCHAR *p_buf, ULONG *p_read) {
-		if (*p_read < FRAME_SIZE_RGB) {
-			return false;
+	static inline void enqueue(Client &client, int index) {
+		Frame &frame = Server::frames[index];
+		int waiting = client.queued - (client.sent ? 1 : 0);
+
+		if (!client.started) {
+			client.started = true;
+			client.start = frame.time;
 		}
 
-		Video::map(p_buf, Video::buf);
-		
-		// Update all screen textures
-		for (int i = 0; i < Video::Screen::Type::SIZE; ++i) {
-			if (Video::screens[i].m_in_texture) {
-				SDL_UpdateTexture(Video::screens[i].m_in_texture, nullptr, Video::buf, CAP_WIDTH * 4);
-			}
+		if (client.policy == Mailbox::Policy::LATEST && waiting) {
+			Server::remove(client, client.queued - 1);
+			++client.drops;
+		}
+
+		else if (waiting >= client.depth) {
+			++client.drops;
+			return;
+		}
+
+		client.queue[client.queued] = index;
+		client.records[client.queued] = { frame.time - client.start, frame.read, 0 };
+
+		++client.queued;
+		++frame.users;
+	}
+
+	static inline void remove(Client &client, int position) {
+		--Server::frames[client.queue[position]].users;
+		--client.queued;
+
+		for (int j = position; j < client.queued; ++j) {
+			client.queue[j] = client.queue[j + 1];
+			client.records[j] = client.records[j + 1];
+		}
+	}
+
+	// everything queued goes out in one call, picking up where the previous one stopped
+	static inline bool flush(size_t i) {
+		Client &client = Server::clients[i];
+
+		struct iovec parts[(SERVER_DEPTH_MAX + 1) * 2];
+		int count = 0;
+
+		for (int j = 0; j < client.queued; ++j) {
+			parts[count++] = { &client.records[j], sizeof(Recorder::Record) };
+			parts[count++] = { Server::frames[client.queue[j]].buf, client.records[j].read };
+		}
+
+		int first = 0;
+		size_t skip = client.sent;
+
+		while (skip >= parts[first].iov_len) {
+			skip -= parts[first++].iov_len;
+		}
+
+		parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + skip;
+		parts[first].iov_len -= skip;
+
+		msghdr message = {};
+		message.msg_iov = &parts[first];
+		message.msg_iovlen = count - first;
+
+		ssize_t done = sendmsg(client.fd, &message, Server::flags);
+
+		if (done < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+
+		size_t total = client.sent + done;
+
+		while (client.queued && total >= sizeof(Recorder::Record) + client.records[0].read) {
+			total -= sizeof(Recorder::Record) + client.records[0].read;
+
+			Server::remove(client, 0);
+			++client.delivered;
 		}
 
+		client.sent = total;
+
 		return true;
 	}
 
-	static inline void map(UCHAR *p_in, UCHAR *p_out) {
-		for (int i = 0, j = DELTA_RES, k = TOP_RES; i < CAP_RES; ++i) {
-			if (i < DELTA_RES) {
-				p_out[4 * i + 0] = p_in[3 * i + 0];
-				p_out[4 * i + 1] = p_in[3 * i + 1];
-				p_out[4 * i + 2] = p_in[3 * i + 2];
-				p_out[4 * i + 3] = 0xff;
-			}
+	static inline bool receive(size_t i) {
+		Client &client = Server::clients[i];
 
-			else if (i / CAP_WIDTH & 1) {
-				p_out[4 * j + 0] = p_in[3 * i + 0];
-				p_out[4 * j + 1] = p_in[3 * i + 1];
-				p_out[4 * j + 2] = p_in[3 * i + 2];
-				p_out[4 * j + 3] = 0xff;
+		char buf[256];
+		ssize_t done = recv(client.fd, buf, sizeof(buf), 0);
 
-				++j;
-			}
+		if (done < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
 
-			else {
-				p_out[4 * k + 0] = p_in[3 * i + 0];
-				p_out[4 * k + 1] = p_in[3 * i + 1];
-				p_out[4 * k + 2] = p_in[3 * i + 2];
-				p_out[4 * k + 3] = 0xff;
+		if (!done) {
+			return false;
+		}
 
-				++k;
-			}
+		client.line.append(buf, done);
+
+		for (size_t end; (end = client.line.find('\n')) != std::string::npos; client.line.erase(0, end + 1)) {
+			Server::configure(client, client.line.substr(0, end));
 		}
+
+		// no policy takes a line this long
+		return client.line.size() < sizeof(buf);
 	}
 
-	static inline void draw() {
-		if (Video::split) {
-			Video::screens[Video::Screen::Type::TOP].draw();
-			Video::screens[Video::Screen::Type::BOT].draw();
+	static inline void configure(Client &client, std::string line) {
+		std::istringstream stream(line);
+		std::string policy;
+		int depth = SERVER_DEPTH;
+
+		stream >> policy >> depth;
+
+		if (policy == "latest") {
+			client.policy = Mailbox::Policy::LATEST;
+		}
+
+		else if (policy == "every") {
+			client.policy = Mailbox::Policy::EVERY;
+			client.depth = std::max(1, std::min(SERVER_DEPTH_MAX, depth));
 		}
 
 		else {
-			Video::screens[Video::Screen::Type::JOINT].draw(
-				&Video::screens[Video::Screen::Type::TOP].m_in_rect,
-				&Video::screens[Video::Screen::Type::TOP].m_out_rect,
-				&Video::screens[Video::Screen::Type::BOT].m_in_rect,
-				&Video::screens[Video::Screen::Type::BOT].m_out_rect
-			);
+			printf("[%s] Socket client %d sent invalid policy \"%s\".\n", NAME, client.fd, policy.c_str());
 		}
 	}
+
+	static inline void accept() {
+		int fd;
+
+		while ((fd = ::accept(Server::listener, nullptr, nullptr)) >= 0) {
+			if (Server::clients.size() >= SERVER_CLIENTS || !Server::nonblocking(fd)) {
+				printf("[%s] Socket client refused.\n", NAME);
+				::close(fd);
+				continue;
+			}
+
+			int size = SERVER_BUFFER;
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+#ifdef SO_NOSIGPIPE
+			int on = 1;
+			setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+			// what a client gets is a recording, whose magic always fits in a new socket's buffer
+			if (send(fd, Recorder::magic, sizeof(Recorder::magic), Server::flags) != sizeof(Recorder::magic)) {
+				::close(fd);
+				continue;
+			}
+
+			Client client = {};
+			client.fd = fd;
+			client.policy = Mailbox::Policy::EVERY;
+			client.depth = SERVER_DEPTH;
+
+			Server::clients.push_back(client);
+
+			printf("[%s] Socket client %d connected.\n", NAME, fd);
+		}
+	}
+
+	static inline void disconnect(size_t i) {
+		Client &client = Server::clients[i];
+
+		while (client.queued) {
+			Server::remove(client, client.queued - 1);
+		}
+
+		::close(client.fd);
+
+		printf("[%s] Socket client %d got %llu and dropped %llu transfers.\n", NAME, client.fd,
+			static_cast<unsigned long long>(client.delivered), static_cast<unsigned long long>(client.drops));
+
+		Server::clients.erase(Server::clients.begin() + i);
+	}
+
+	static inline bool nonblocking(int fd) {
+		return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != -1;
+	}
+
+#ifdef MSG_NOSIGNAL
+	static constexpr int flags = MSG_NOSIGNAL;
+#else
+	static constexpr int flags = 0;
+#endif
 };
 
 void load(std::string path, std::string name) {
@@ -1411,7 +5413,7 @@ void load(std::string path, std::string name) {
 		std::istringstream kvp(line);
 		std::string key;
 
-		Video::Screen *p_screen;
+		Video::Screen *p_screen = nullptr;
 
 		if (std::getline(kvp, key, '_')) {
 			p_screen = Video::screen(key);
@@ -1497,7 +5499,14 @@ void save(std::string path, std::string name) {
 	}
 }
 
+// the benchmarks build this file without its entry point
+#ifndef XX3DSDL_NO_MAIN
 int main(int argc, char **argv) {
+	const char *replay = nullptr;
+	const char *record = nullptr;
+	int screenshots = 0;
+	bool fast = false;
+
 	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "--auto") == 0) {
 			Capture::auto_connect = true;
@@ -1514,9 +5523,159 @@ int main(int argc, char **argv) {
 			continue;
 		}
 
+		if (strcmp(argv[i], "--audio-target") == 0 && i + 1 < argc) {
+			Audio::target = std::max(5, std::min(200, atoi(argv[++i])));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--audio-latency") == 0 && i + 1 < argc) {
+			if (strcmp(argv[++i], "auto") == 0) {
+				Audio::adaptive = true;
+				Audio::frames = AUDIO_FRAMES_AUTO;
+			}
+
+			else {
+				char *p_end;
+				long frames = strtol(argv[i], &p_end, 10);
+
+				// a typo would otherwise read as 0 and pick the smallest, most underrun prone buffer
+				if (p_end == argv[i] || *p_end) {
+					printf("[%s] Invalid audio latency \"%s\".\n", NAME, argv[i]);
+					continue;
+				}
+
+				// sdl wants a power of two
+				Audio::frames = AUDIO_FRAMES_MIN;
+
+				while (Audio::frames < std::min<long>(AUDIO_FRAMES_MAX, frames)) {
+					Audio::frames *= 2;
+				}
+			}
+
+			continue;
+		}
+
+		if (strcmp(argv[i], "--opengl") == 0) {
+			Video::opengl = true;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			record = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--compress") == 0) {
+			Recorder::compress = true;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+			screenshots = std::max(1, atoi(argv[++i]));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+			Video::Screenshot::burst = std::max(1, atoi(argv[++i]));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--headless") == 0 && i + 2 < argc) {
+			Headless::enabled = true;
+			Headless::video = atoi(argv[++i]);
+			Headless::audio = atoi(argv[++i]);
+			continue;
+		}
+
+		if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+			Share::name = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+			Server::path = argv[++i];
+			continue;
+		}
+
+		if (strcmp(argv[i], "--clip") == 0 && i + 1 < argc) {
+			Clip::seconds = std::max(1, atoi(argv[++i]));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--clip-memory") == 0 && i + 1 < argc) {
+			Clip::memory = std::max(16, atoi(argv[++i]));
+			continue;
+		}
+
+		if (strcmp(argv[i], "--fast") == 0) {
+			fast = true;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--stats") == 0) {
+			Stats::enabled = true;
+			continue;
+		}
+
 		printf("[%s] Invalid argument \"%s\".\n", NAME, argv[i]);
 	}
 
+	// nothing but the capture thread and the two streams, so no display or audio device is needed, and it keeps reconnecting
+	// to the N3DSXL on its own since there are no keys to do it with
+	if (Headless::enabled) {
+		if (SDL_Init(0) < 0 || !Headless::open()) {
+			printf("[%s] Headless start failed.\n", NAME);
+			return -1;
+		}
+
+		Capture::auto_connect = true;
+		Capture::p_source = replay ? static_cast<Source*>(new Replay(replay, fast)) : new Device();
+
+		Video::dispatch();
+		Headless::dispatch();
+		Codec::dispatch();
+
+		if (record) {
+			Recorder::start(record);
+		}
+
+		if (!Share::name.empty()) {
+			Share::open();
+		}
+
+		if (!Server::path.empty()) {
+			Server::open();
+		}
+
+		if (Clip::seconds) {
+			Clip::open();
+		}
+
+		Capture::mailboxes.push_back(&Headless::mailbox);
+		std::thread capture = std::thread(Capture::stream, nullptr, nullptr);
+
+		Headless::run();
+		g_running = false;
+
+		capture.join();
+
+		Clip::close();
+		Server::close();
+		Share::close();
+		Recorder::stop();
+		Headless::close();
+
+		delete Capture::p_source;
+		SDL_Quit();
+
+		return 0;
+	}
+
 	// Initialize SDL2
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
 		printf("[%s] SDL_Init failed: %s\n", NAME, SDL_GetError());
@@ -1536,6 +5695,13 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	// kmsdrm only offers gles, which the shader is written to build on as well
+	if (Video::opengl && g_kmsdrm) {
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+	}
+
 	if (g_kmsdrm) {
 		Uint8 l_data[1] = {0};
 		Uint8 l_mask[1] = {0};
@@ -1555,12 +5721,25 @@ int main(int argc, char **argv) {
 		load(CONF_DIR, std::string(NAME) + ".conf");
 	}
 
+	if (replay) {
+		Capture::p_source = new Replay(replay, fast);
+	}
+	else {
+		Capture::p_source = new Device();
+	}
+
+	Video::dispatch();
+	Audio::dispatch();
+	Codec::dispatch();
+
 	Capture::connected = Capture::connect();
 	Audio::p_audio = new Audio();
 
 	Video::p_load = &load;
 	Video::p_save = &save;
 
+	Video::Layout::build();
+
 	Video::screens[Video::Screen::Type::TOP].build(Video::Screen::Type::TOP, 0, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], Video::split);
 	Video::screens[Video::Screen::Type::BOT].build(Video::Screen::Type::BOT, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], Video::Screen::widths[Video::Screen::Crop::SCALED_DS], Video::split);
 	Video::screens[Video::Screen::Type::JOINT].build(Video::Screen::Type::JOINT, 0, Video::Screen::widths[Video::Screen::Crop::DEFAULT_3DS], !Video::split);
@@ -1570,15 +5749,52 @@ int main(int argc, char **argv) {
 	Video::init();
 	Video::blank();
 
-	std::thread capture = std::thread(Capture::stream, &Audio::promise, &Video::promise, &Audio::waiting, &Video::waiting);
+	if (record) {
+		Recorder::start(record);
+	}
+
+	Video::Screenshot::start();
+
+	if (screenshots) {
+		Video::Screenshot::request(screenshots, Video::Screen::Type::JOINT);
+	}
+
+	if (!Share::name.empty()) {
+		Share::open();
+	}
+
+	if (!Server::path.empty()) {
+		Server::open();
+	}
+
+	if (Clip::seconds) {
+		Clip::open();
+	}
+
+	std::thread capture = std::thread(Capture::stream, &Audio::mailbox, &Video::mailbox);
 	std::thread audio = std::thread(Audio::playback);
 
 	Video::render();
 	audio.join();
 
-	g_finished = true;
 	capture.join();
 
+	Clip::close();
+	Server::close();
+	Share::close();
+	Recorder::stop();
+	Video::Screenshot::stop();
+
+	Audio::report(Audio::adaptive ? "settled at" : "was");
+
+	printf("[%s] Video dropped %llu and overran %llu transfers, audio dropped %llu and overran %llu.\n", NAME,
+		static_cast<unsigned long long>(Video::mailbox.m_drops), static_cast<unsigned long long>(Video::mailbox.m_overruns),
+		static_cast<unsigned long long>(Audio::mailbox.m_drops), static_cast<unsigned long long>(Audio::mailbox.m_overruns));
+
+	Stats::report(&Video::mailbox);
+
+	delete Capture::p_source;
+
 	Video::screens[Video::Screen::Type::TOP].close();
 	Video::screens[Video::Screen::Type::BOT].close();
 	Video::screens[Video::Screen::Type::JOINT].close();
@@ -1593,3 +5809,4 @@ int main(int argc, char **argv) {
 
 	return 0;
 }
+#endif